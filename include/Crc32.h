@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Helpers for the (zlib compatible) crc32, as computed by esp_rom_crc32_le(0, ...)
+// combine() allows to checksum both planes of an image while they are read interleaved,
+// see x2nmodp() and crc32_combine() in zlib.
+
+namespace Soylent {
+    namespace Crc32 {
+        // multiply a and b modulo the crc polynomial (reflected)
+        inline uint32_t multModP(uint32_t a, uint32_t b) {
+            uint32_t m = static_cast<uint32_t>(1) << 31;
+            uint32_t p = 0;
+            for (;;) {
+                if (a & m) {
+                    p ^= b;
+                    if ((a & (m - 1)) == 0)
+                        break;
+                }
+                m >>= 1;
+                b = (b & 1) ? (b >> 1) ^ 0xEDB88320u : b >> 1;
+            }
+            return p;
+        }
+
+        // x^(8 * len) modulo the crc polynomial
+        inline uint32_t x8nModP(size_t len) {
+            uint32_t p = static_cast<uint32_t>(1) << 31;  // x^0
+            uint32_t x2k = static_cast<uint32_t>(1) << 23; // x^8
+            while (len) {
+                if (len & 1)
+                    p = multModP(x2k, p);
+                len >>= 1;
+                x2k = multModP(x2k, x2k);
+            }
+            return p;
+        }
+
+        // crc of (A || B) from crc(A), crc(B) and the length of B
+        inline uint32_t combine(uint32_t crcA, uint32_t crcB, size_t lenB) {
+            return multModP(x8nModP(lenB), crcA) ^ crcB;
+        }
+    } // namespace Crc32
+} // namespace Soylent
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// number of display jobs kept for statistics
+#ifndef CONFIG_DISPLAY_METRICS_SIZE
+    #define CONFIG_DISPLAY_METRICS_SIZE 16
+#endif
+
+namespace Soylent {
+    // Timing of display jobs, split into phases (in µs)
+    // Jobs are recorded by the display worker into a ring buffer, which can be read from any task.
+    class DisplayMetrics {
+    public:
+        enum Phase : uint8_t {
+            QUEUE_WAIT,                 // from enqueueing to the worker picking it up
+            FILE_READ,                  // opening, reading (and decompressing) from LittleFS
+            DECODE,                     // transforming, composing and diffing frames
+            SPI_TRANSFER,               // writing to the panel's RAM
+            REFRESH,                    // waiting for the panel to refresh
+            POWER_OFF,                  // waiting for the panel to power off
+            PREFETCH,                   // reading the next image, while the panel is refreshing (overlaps REFRESH)
+            PHASE_COUNT
+        };
+
+        struct job_metrics
+        {
+            const char* command;
+            uint32_t phase_us[PHASE_COUNT];
+            uint32_t total_us;
+            uint32_t spi_bytes;
+            uint32_t spi_transfers;
+        };
+
+        struct phase_summary
+        {
+            uint32_t min_us;
+            uint32_t avg_us;
+            uint32_t max_us;
+        };
+
+        DisplayMetrics();
+        static const char* getPhaseName(Phase phase);
+        void beginJob(const char* command, int64_t enqueuedUs);
+        void add(Phase phase, int64_t sinceUs);
+        void endJob(uint32_t spiBytes, uint32_t spiTransfers);
+        void setPrefetching(bool prefetching);
+        bool getJob(size_t index, job_metrics& job);
+        size_t getSummary(phase_summary* summary);
+
+    private:
+        job_metrics _job;               // job in progress
+        int64_t _jobStartUs;
+        bool _prefetching;              // phases are accounted to PREFETCH
+        job_metrics _jobs[CONFIG_DISPLAY_METRICS_SIZE];
+        size_t _next;
+        size_t _count;
+    };
+} // namespace Soylent
@@ -6,73 +6,338 @@
 
 #include <TaskSchedulerDeclarations.h>
 #include <GxEPD2_3C.h>
+#include <atomic>
+#include <FrameCache.h>
+#include <TextLayout.h>
+#include <FrameCanvas.h>
+#include <PanelBus.h>
+#include <PlaneDecoder.h>
+#include <DisplayMetrics.h>
 
 #define BLANK_TEXT 0
 #define NAME_TAG_BLACK 1
 #define NAME_TAG_RED 2
 
+// number of rows streamed to the panel at once
+#ifndef CONFIG_DISPLAY_BAND_ROWS
+    #define CONFIG_DISPLAY_BAND_ROWS 8
+#endif
+
+// panel-native image container, see tools/svg2rbmono.py
+#define EPD_IMAGE_MAGIC 0x49445045 // "EPDI"
+#define EPD_IMAGE_VERSION 1
+#define EPD_IMAGE_ROTATION 2
+// encoding of the planes (eFlags), compressed planes are preceded by the size of the black plane (uint32)
+#define EPD_IMAGE_FLAG_RLE 0x01
+#define EPD_IMAGE_FLAG_LZSS 0x02
+#define EPD_IMAGE_FLAG_ENCODING (EPD_IMAGE_FLAG_RLE | EPD_IMAGE_FLAG_LZSS)
+
+// SPI clock of the panel (in Hz), can be changed at runtime up to the maximum of the panel
+#ifndef CONFIG_DISPLAY_SPI_CLOCK
+    #define CONFIG_DISPLAY_SPI_CLOCK 4000000
+#endif
+
+// longest sleep while waiting for the panel being busy (in ms), GxEPD2's timeout is checked in between
+#ifndef CONFIG_DISPLAY_BUSY_WAIT_MS
+    #define CONFIG_DISPLAY_BUSY_WAIT_MS 1000
+#endif
+
+// number of display commands that can be queued
+#ifndef CONFIG_DISPLAY_QUEUE_LENGTH
+    #define CONFIG_DISPLAY_QUEUE_LENGTH 4
+#endif
+
+// byte budget for caching decoded frames (in PSRAM or, without PSRAM, in internal RAM)
+#ifndef CONFIG_DISPLAY_FRAME_CACHE_SIZE
+    #define CONFIG_DISPLAY_FRAME_CACHE_SIZE 32768
+#endif
+#ifndef CONFIG_DISPLAY_FRAME_CACHE_SIZE_INTERNAL
+    #define CONFIG_DISPLAY_FRAME_CACHE_SIZE_INTERNAL 0
+#endif
+
+// maximum length of an image name (including terminating zero)
+#ifndef CONFIG_DISPLAY_IMAGE_NAME_LENGTH
+    #define CONFIG_DISPLAY_IMAGE_NAME_LENGTH 64
+#endif
+
+// maximum length of a text to print, in bytes of UTF-8 (including terminating zero)
+#ifndef CONFIG_DISPLAY_TEXT_LENGTH
+    #define CONFIG_DISPLAY_TEXT_LENGTH 256
+#endif
+
+// maximum number of layers drawn over the background of a composition
+#ifndef CONFIG_DISPLAY_LAYERS
+    #define CONFIG_DISPLAY_LAYERS 8
+#endif
+
+// maximum length of the state of a panel, rendered as json (including terminating zero)
+#ifndef CONFIG_DISPLAY_STATE_LENGTH
+    #define CONFIG_DISPLAY_STATE_LENGTH 128
+#endif
+
+// panel driver of GxEPD2 the firmware is built for
+#ifndef DISPLAY_PANEL
+    #define DISPLAY_PANEL GxEPD2_154_Z90c
+#endif
+
+// number of panels, each one is driven by a worker of its own (up to 3, see main.cpp)
+#ifndef CONFIG_DISPLAY_COUNT
+    #define CONFIG_DISPLAY_COUNT 1
+#endif
+#if CONFIG_DISPLAY_COUNT < 1 || CONFIG_DISPLAY_COUNT > 3
+    #error "CONFIG_DISPLAY_COUNT must be 1, 2 or 3"
+#endif
+
 namespace Soylent {
+    // pins a panel is connected to, panels on a shared SPI bus are using the same SPI pins
+    struct display_pins
+    {
+        int16_t cs;
+        int16_t dc;
+        int16_t rst;
+        int16_t busy;
+        int8_t sck;
+        int8_t miso;
+        int8_t mosi;
+        int8_t ss;
+    };
+
+    // how to print a text, the box is given in display coordinates (after rotation)
+    struct text_style
+    {
+        uint8_t font_id;            // see TextLayout::findFont()
+        uint8_t scale;
+        TextAlign align;
+        TextVAlign valign;
+        uint16_t color;             // GxEPD_BLACK or GxEPD_RED (or GxEPD_WHITE for rectangles)
+        int16_t box_x;
+        int16_t box_y;
+        int16_t box_w;
+        int16_t box_h;
+    };
+
+    // kinds of layers drawn over the background of a composition
+    enum class LayerType : uint8_t {
+        TEXT,                       // text, laid out in the box of the style
+        RECT,                       // box of the style, filled with its color (GxEPD_WHITE clears)
+        ICON                        // panel image (.epd) of any size at the box's origin, white is transparent
+    };
+
+    // a layer of a composition, the content is the text or the base name of the icon
+    struct display_layer
+    {
+        LayerType type;
+        text_style style;
+        const char* content;
+    };
+
+    struct __attribute__ ((packed, aligned(1))) BITMAPFILEHEADER {
+        uint16_t bType;             // identifier
+        uint32_t bSize;             // filesize
+        uint16_t bReserved1;        // reserved
+        uint16_t bReserved2;        // reserved
+        uint32_t bOffset;           // offset to start of pixel data
+    };
+
+    struct __attribute__ ((packed, aligned(1))) BITMAPINFOHEADER {
+        uint32_t biInfoSize;        // size of this header
+        int32_t biWidth;            // width
+        int32_t biHeight;           // height
+        uint16_t biPlanes;          // number of planes
+        uint16_t biBitCount;        // bits per pixel
+        uint32_t biCompression;     // compression type
+        uint32_t biImageSize;       // size of the image, in bytes
+        int32_t biXPelsPerMeter;    // horizontal resolution
+        int32_t biYPelsPerMeter;    // vertical resolution
+        uint32_t biClrUsed;         // number of colors used
+        uint32_t biClrImportant;    // number of important colors
+    };
+
+    struct __attribute__ ((packed, aligned(1))) EPDIMAGEHEADER {
+        uint32_t eMagic;            // identifier
+        uint8_t eVersion;           // container version
+        uint8_t eRotation;          // rotation the planes were prepared for
+        uint8_t eFlags;             // encoding of the planes
+        uint8_t eReserved;          // reserved
+        uint16_t eWidth;            // width
+        uint16_t eHeight;           // height
+        uint32_t ePlaneSize;        // size of each plane, in bytes
+        uint32_t eChecksum;         // crc32 over both planes
+    };
+
+    // Properties of a panel, which are not exposed by GxEPD2
+    // unknown panels are driven by GxEPD2 only, at a conservative SPI clock
+    template <class Panel>
+    struct panel_traits
+    {
+        static constexpr uint8_t busy_level = LOW;
+        static constexpr uint32_t spi_clock_max = 4000000;
+        static constexpr bool bulk_ram = false;     // RAM can be written by PanelBus
+    };
+
+    // the SSD1681 is pulling BUSY high while busy, it is specified for up to 20 MHz
+    template <>
+    struct panel_traits<GxEPD2_154_Z90c>
+    {
+        static constexpr uint8_t busy_level = HIGH;
+        static constexpr uint32_t spi_clock_max = 20000000;
+        static constexpr bool bulk_ram = true;
+    };
+
+    // Display worker for a tri-color panel of GxEPD2 (e.g. GxEPD2_154_Z90c)
+    // The geometry of the panel's RAM is known at compile time, buffers are sized accordingly.
+    template <class Panel>
     class DisplayClass {
     public:
-        DisplayClass(SPIClass& spi);
+        static constexpr uint16_t WIDTH = Panel::WIDTH;
+        static constexpr uint16_t HEIGHT = Panel::HEIGHT;
+        static constexpr uint8_t ROTATION = EPD_IMAGE_ROTATION;
+        static constexpr size_t ROW_BYTES = WIDTH / 8;
+        static constexpr size_t BMP_ROW_BYTES = (WIDTH + 31) / 32 * 4;  // bitmap rows are aligned by 4 bytes
+        static constexpr size_t PLANE_BYTES = ROW_BYTES * HEIGHT;
+        static constexpr size_t FRAME_BYTES = 2 * PLANE_BYTES;
+        static constexpr size_t BAND_BYTES = CONFIG_DISPLAY_BAND_ROWS * ROW_BYTES;
+        static constexpr size_t PATH_LENGTH = CONFIG_DISPLAY_IMAGE_NAME_LENGTH + 8;  // "/" + base name + ".r.bmp"
+        static_assert(WIDTH % 8 == 0, "rows of the panel must be byte aligned");
+
+        DisplayClass(SPIClass& spi, const display_pins& pins);
         void begin(Scheduler* scheduler);
         void end();
-        void wipeDisplay();
-        void printCenteredTag(uint16_t tagID);
-        void showImage(const char* imageName);
+        bool wipeDisplay();
+        bool printCenteredTag(uint16_t tagID = NAME_TAG_BLACK);
+        bool showImage(const char* imageName, const char* nextImageName = nullptr);
+        bool printText(const char* text, const text_style& style);
+        bool showComposition(const char* imageName, const display_layer* layers, size_t count);
+        void invalidateImageCache();
+        void setImageCacheBudget(size_t budget);
+        bool setSpiClock(uint32_t clock);
+        uint32_t getSpiClock();
+        DisplayMetrics& getMetrics();
+        const uint8_t* getFrame(uint32_t& hash);
         void powerOff(); 
         void hibernate();
         bool isInitialized();
         bool isBusy();
+        const char* getJob();
+        bool isRefreshing();
+        void setImageIndex(int32_t imgIdx);
+        uint32_t getStateVersion();
+        size_t getState(char* buffer, size_t size, uint32_t& version);
 
-        // struct for passing parameters to async functions
-        struct async_params
-        {
-            StatusRequest* srBusy;
-            GxEPD2_3C<GxEPD2_154_Z90c, 200>* display;
-            uint16_t* text_color;
-            std::string* text_content;
-            std::string* image_name;
+        // commands processed by the display worker
+        enum class CommandType : uint8_t {
+            WIPE,
+            PRINT_TAG,
+            PRINT_TEXT,
+            SHOW_IMAGE,
+            COMPOSE
         };
 
-        struct __attribute__ ((packed, aligned(1))) BITMAPFILEHEADER {
-            uint16_t bType;             // identifier
-            uint32_t bSize;             // filesize
-            uint16_t bReserved1;        // reserved
-            uint16_t bReserved2;        // reserved
-            uint32_t bOffset;           // offset to start of pixel data
+        // a layer as passed to the worker, the content is stored in the text of the command
+        struct command_layer
+        {
+            LayerType type;
+            text_style style;
+            uint16_t content_offset;
         };
 
-        struct __attribute__ ((packed, aligned(1))) BITMAPINFOHEADER {
-            uint32_t biInfoSize;        // size of this header
-            int32_t biWidth;            // width
-            int32_t biHeight;           // height
-            uint16_t biPlanes;          // number of planes
-            uint16_t biBitCount;        // bits per pixel
-            uint32_t biCompression;     // compression type
-            uint32_t biImageSize;       // size of the image, in bytes
-            int32_t biXPelsPerMeter;    // horizontal resolution
-            int32_t biYPelsPerMeter;    // vertical resolution
-            uint32_t biClrUsed;         // number of colors used
-            uint32_t biClrImportant;    // number of important colors
+        // struct for passing a command to the display worker
+        struct display_command
+        {
+            CommandType type;
+            int64_t enqueued_us;
+            uint16_t tag_id;
+            char image_name[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];
+            char next_image_name[CONFIG_DISPLAY_IMAGE_NAME_LENGTH]; // read while the panel is refreshing
+            text_style style;
+            char text[CONFIG_DISPLAY_TEXT_LENGTH];
+            uint8_t layer_count;
+            command_layer layers[CONFIG_DISPLAY_LAYERS];
         };
 
     private:
+        // what the state of the panel was rendered from
+        struct state_snapshot
+        {
+            const char* state;
+            int32_t img_idx;
+            const char* job;
+            bool refreshing;
+        };
+
         void _initializeDisplayCallback();
-        void _wipeDisplayCallback();
-        static void _async_wipeDisplayTask(void* pvParameters);
-        void _printCenteredTextCallback();
-        static void _async_printCenteredTextTask(void* pvParameters);
-        void _showImageCallback();
-        static void _async_showImageTask(void* pvParameters);
-        GxEPD2_3C<GxEPD2_154_Z90c, 200> _display;
+        bool _enqueue(display_command& command);
+        static bool _isLatestWins(CommandType type);
+        static const char* _getCommandName(CommandType type);
+        static void _displayWorkerTask(void* pvParameters);
+        static void _busyCallback(const void* pvParameters);
+        static void _busyISR(void* pvParameters);
+        void _wipeDisplay();
+        void _printCenteredText(uint16_t tagID);
+        void _printText(const char* text, const text_style& style);
+        void _showImage(const char* imageName, const char* nextImageName);
+        void _compose(const display_command& command);
+        bool _drawIcon(FrameCanvas& canvas, const char* baseName, int16_t x, int16_t y);
+        void _prefetchImage();
+        static bool _getBaseName(const char* imageName, char* baseName);
+        static bool _getFileName(char* fileName, const char* baseName, const char* extension);
+        void _pushBand(uint16_t y, uint16_t rows, const uint8_t* black, const uint8_t* red);
+        void _pushFrame(const uint8_t* frame);
+        void _refreshPanel(const char* prefetchImageName = nullptr);
+        void _powerOffPanel();
+        bool _loadGlassHash();
+        void _storeGlassHash(bool valid, uint32_t hash = 0);
+        state_snapshot _getStateSnapshot();
+        void _updateState();
+        bool _beginPanelImage(const char* baseName, File& file, EPDIMAGEHEADER& epdHeader);
+        bool _writePanelImage(const char* baseName, uint8_t* frame, bool toPanel = true);
+        bool _writeBitmapImage(const char* baseName, uint8_t* frame, bool toPanel = true);
+        // content is composed off-screen, GxEPD2's paged drawing is not used
+        display_pins _pins;
+        GxEPD2_3C<Panel, CONFIG_DISPLAY_BAND_ROWS> _display;
         SPIClass* _spi;
+        PanelBus _bus;
+        std::atomic<uint32_t> _spiClock;
         StatusRequest _srInitialized;
         StatusRequest _srBusy;
         Scheduler* _scheduler;
-        struct async_params _async_params;
-        uint16_t _text_color;
-        std::string _text_content;
-        std::string _image_name;
+        QueueHandle_t _commandQueue;
+        TaskHandle_t _workerTask;
+        volatile TaskHandle_t _busyWaiter;
+        uint32_t _pendingCommands;
+        FrameCache _frameCache;
+        std::atomic<size_t> _frameCacheBudget;
+        std::atomic<bool> _frameCacheInvalid;
+        uint8_t* _shadowFrame;
+        uint8_t* _composeFrame;
+        std::atomic<bool> _shadowValid;
+        std::atomic<uint32_t> _glassHash;   // crc32 of the frame shown by the panel (kept in NVS across restarts)
+        std::atomic<bool> _glassValid;
+        uint32_t _storedHash;               // hash in NVS, so unchanged hashes aren't written again
+        bool _storedValid;
+        char _glassKey[12];
+        std::atomic<const char*> _job;      // name of the command being processed, nullptr while idle
+        std::atomic<bool> _refreshing;      // waiting for the panel to refresh
+        std::atomic<int32_t> _imageIdx;     // image of the website's catalog shown by the panel (-1 for others)
+        state_snapshot _stateSnapshot;      // the state is rendered only when changed, guarded by cs_spinlock
+        char _stateJson[CONFIG_DISPLAY_STATE_LENGTH];
+        size_t _stateLength;
+        uint32_t _stateVersion;             // increased with every change, starting at random (for ETags across restarts)
+        uint8_t* _prefetchFrame;        // spare frame for the next image, read while the panel is refreshing
+        char _prefetchName[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];
+        char _prefetchPending[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];
+        bool _prefetchValid;
+        TextLayout _textLayout;
+        PlaneDecoder _decoderBlack;     // decoders of panel images, kept off the worker's stack
+        PlaneDecoder _decoderRed;
+        DisplayMetrics _metrics;
+        // buffers for streaming images to the panel in bands of rows
+        // ...the raw buffer holds a band of bitmap rows
+        uint8_t _bandBlack[BAND_BYTES];
+        uint8_t _bandRed[BAND_BYTES];
+        uint8_t _bandRaw[CONFIG_DISPLAY_BAND_ROWS * BMP_ROW_BYTES];
     };
+
+    // the display of this firmware
+    using PanelDisplayClass = DisplayClass<DISPLAY_PANEL>;
 } // namespace Soylent
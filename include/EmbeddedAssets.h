@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Soylent {
+    // Asset embedded into the firmware, the table (asset_table.h) is created by tools/assets.py
+    struct embedded_asset
+    {
+        const char* path;               // served at
+        const char* mime_type;
+        const char* encoding;           // Content-Encoding of the data
+        const uint8_t* data;
+        size_t size;
+        const char* etag;               // crc32 of the data at build time (quoted)
+        bool portal;                    // served while the captive portal is shown (instead of the website)
+    };
+
+    const embedded_asset* find_embedded_asset(const char* path);
+} // namespace Soylent
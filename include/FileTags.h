@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// maximum number of files with a known content hash (ETag)
+#ifndef CONFIG_WEBSITE_FILE_TAGS
+    #define CONFIG_WEBSITE_FILE_TAGS 32
+#endif
+
+// maximum length of an image name, which is the path of a file (including terminating zero)
+#ifndef CONFIG_DISPLAY_IMAGE_NAME_LENGTH
+    #define CONFIG_DISPLAY_IMAGE_NAME_LENGTH 64
+#endif
+
+namespace Soylent {
+    // Content hashes (crc32) of files on LittleFS, used as ETags
+    // A file is hashed when it's requested first, later requests are answered without reading it.
+    // The hashes of changed files need to be dropped by the caller (e.g. after uploads).
+    // Not thread-safe, it's meant to be used by the handlers of the web server only.
+    class FileTags {
+    public:
+        FileTags();
+        bool get(const char* path, uint32_t& hash);
+        void clear();
+
+    private:
+        struct file_tag
+        {
+            char path[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];
+            uint32_t hash;
+            uint32_t last_used;         // 0 for unused entries
+        };
+
+        bool _hash(const char* path, uint32_t& hash);
+        file_tag _tags[CONFIG_WEBSITE_FILE_TAGS];
+        uint32_t _uses;
+        uint8_t _buffer[256];           // for reading files, kept off the stack of the web server
+    };
+} // namespace Soylent
@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Soylent {
+    // Bitmap (4 bit, indexed: white, black, red) of a panel frame (black plane followed by red plane)
+    // The bitmap is generated on the fly at any offset, so it can be streamed in chunks without a copy of the image.
+    // The rotation is applied like GxEPD2_3C, so the bitmap shows what's seen on the panel.
+    class FrameBitmap {
+    public:
+        FrameBitmap(const uint8_t* frame, uint16_t panelWidth, uint16_t panelHeight, uint8_t rotation);
+        size_t getSize() const;
+        size_t read(uint8_t* dst, size_t length, size_t index) const;
+
+    private:
+        static constexpr size_t HEADER_SIZE = 14 + 40 + 3 * 4; // file header, info header and palette
+        void _writeHeader(uint8_t* header) const;
+        uint8_t _getPixel(uint16_t x, uint16_t y) const;
+        const uint8_t* _frame;
+        uint16_t _panelWidth;
+        uint16_t _panelHeight;
+        uint8_t _rotation;
+        uint16_t _width;                // after rotation
+        uint16_t _height;
+        size_t _rowSize;                // rows are aligned by 4 bytes
+    };
+} // namespace Soylent
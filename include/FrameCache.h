@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// maximum number of frames in the cache (the budget is limiting as well)
+#ifndef CONFIG_DISPLAY_FRAME_CACHE_SLOTS
+    #define CONFIG_DISPLAY_FRAME_CACHE_SLOTS 8
+#endif
+
+// maximum length of an image name, which is the key of a frame (including terminating zero)
+#ifndef CONFIG_DISPLAY_IMAGE_NAME_LENGTH
+    #define CONFIG_DISPLAY_IMAGE_NAME_LENGTH 64
+#endif
+
+namespace Soylent {
+    // LRU cache of ready-to-send panel frames (black plane followed by red plane)
+    // Frames are kept in a fixed number of slots. Dropped frames are re-used for the next ones,
+    // so nothing is allocated once the budget is filled (unless the budget is changed).
+    // Not thread-safe, it's meant to be used by the display worker only.
+    class FrameCache {
+    public:
+        FrameCache();
+        ~FrameCache();
+        void setBudget(size_t budget);
+        size_t getBudget();
+        size_t getUsage();
+        const uint8_t* get(const char* key);
+        uint8_t* insert(const char* key, size_t frameSize);
+        void commit(const char* key);
+        void remove(const char* key);
+        void clear();
+
+    private:
+        struct cache_entry
+        {
+            char key[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];
+            uint8_t* frame;             // kept for re-use, while the entry is unused
+            size_t size;
+            uint32_t last_used;         // 0 for unused entries
+            bool valid;
+        };
+        cache_entry* _find(const char* key);
+        cache_entry* _findUnused(bool allocated, size_t size = 0);
+        cache_entry* _findLeastRecentlyUsed();
+        void _free(cache_entry* entry);
+        void _trim();
+        cache_entry _entries[CONFIG_DISPLAY_FRAME_CACHE_SLOTS];
+        uint32_t _uses;
+        size_t _budget;
+        size_t _usage;                  // bytes allocated, including the frames kept for re-use
+    };
+} // namespace Soylent
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <Adafruit_GFX.h>
+#include <GxEPD2.h>
+
+namespace Soylent {
+    // Adafruit_GFX drawing surface over a panel frame (black plane followed by red plane)
+    // The planes are in the byte order of the panel's RAM (0 = ink), rotation is handled like GxEPD2_3C,
+    // so a frame drawn here can be written to the panel without any transformation.
+    class FrameCanvas : public Adafruit_GFX {
+    public:
+        FrameCanvas(uint8_t* frame, int16_t w, int16_t h);
+        void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+        void fillScreen(uint16_t color) override;
+        uint8_t* getFrame();
+        size_t getPlaneSize();
+
+    private:
+        uint8_t* _frame;
+        size_t _planeSize;
+    };
+} // namespace Soylent
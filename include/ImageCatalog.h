@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// maximum number of images in the catalog (images.json)
+#ifndef CONFIG_WEBSITE_CATALOG_SIZE
+    #define CONFIG_WEBSITE_CATALOG_SIZE 32
+#endif
+
+// maximum length of the name of an image shown on the website (including terminating zero)
+#ifndef CONFIG_WEBSITE_CATALOG_NAME_LENGTH
+    #define CONFIG_WEBSITE_CATALOG_NAME_LENGTH 48
+#endif
+
+// maximum length of an image name, which is the src of an image (including terminating zero)
+#ifndef CONFIG_DISPLAY_IMAGE_NAME_LENGTH
+    #define CONFIG_DISPLAY_IMAGE_NAME_LENGTH 64
+#endif
+
+namespace Soylent {
+    // Index of the images shown on the website (images.json), by img_idx (starting at 1)
+    // The json is parsed once from the file into fixed-size entries, requests don't walk any json.
+    // Not thread-safe, it's meant to be used by the handlers of the web server only.
+    class ImageCatalog {
+    public:
+        struct catalog_entry
+        {
+            char name[CONFIG_WEBSITE_CATALOG_NAME_LENGTH];  // shown on the website
+            char src[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];     // image on the website, the display uses its base name
+        };
+
+        ImageCatalog();
+        bool load(const char* path);
+        bool update(const char* path, const char* name, const char* src);
+        const catalog_entry* get(int32_t imgIdx) const;
+        size_t size() const;
+
+    private:
+        int32_t _find(const char* src) const;
+        catalog_entry _entries[CONFIG_WEBSITE_CATALOG_SIZE];
+        size_t _count;
+    };
+} // namespace Soylent
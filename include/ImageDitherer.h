@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Soylent {
+    // Streaming Floyd-Steinberg dithering of RGB images to black/red/white panel planes
+    // The image is consumed in arbitrary chunks, pixel by pixel, with a two-row error buffer;
+    // only the planes (in the byte order of the panel's RAM) are held in memory.
+    // Images of a different size are centered on the panel (cropped or padded with white).
+    class ImageDitherer {
+    public:
+        enum class Format : uint8_t {
+            BMP,                        // 24 or 32 bit uncompressed bitmap (bottom-up or top-down)
+            RGB                         // raw RGB888, rows top to bottom
+        };
+
+        ImageDitherer(uint16_t panelWidth, uint16_t panelHeight);
+        ~ImageDitherer();
+        bool begin(Format format, uint16_t width = 0, uint16_t height = 0);
+        bool write(const uint8_t* data, size_t length);
+        bool isComplete();
+        const char* getError();
+        bool isOutOfMemory();
+        const uint8_t* getFrame();
+        size_t getPlaneSize();
+        bool save(const char* fileName);
+
+    private:
+        enum class State : uint8_t {
+            HEADER,
+            SKIP,
+            PIXELS,
+            DONE,
+            FAILED
+        };
+        bool _parseHeader();
+        void _startPixels(int32_t width, int32_t height, bool bottomUp, uint8_t bytesPerPixel, uint8_t rowPadding);
+        void _fail(const char* error);
+        void _pixel(int16_t r, int16_t g, int16_t b);
+        void _nextRow();
+        uint16_t _panelWidth;
+        uint16_t _panelHeight;
+        uint16_t _rowBytes;
+        uint8_t* _frame;                // black plane followed by red plane
+        int16_t* _errors;               // two rows of RGB errors (scaled by 16)
+        int16_t* _errorsCurrent;
+        int16_t* _errorsNext;
+        Format _format;
+        State _state;
+        const char* _error;
+        uint8_t _header[54];
+        size_t _headerFill;
+        uint32_t _skip;
+        int32_t _width;
+        int32_t _height;
+        bool _bottomUp;
+        uint8_t _bytesPerPixel;
+        uint8_t _rowPadding;
+        int32_t _offsetX;
+        int32_t _offsetY;
+        int32_t _column;
+        int32_t _row;
+        uint8_t _pixelBytes[4];
+        uint8_t _pixelFill;
+        uint8_t _paddingLeft;
+    };
+} // namespace Soylent
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <SPI.h>
+#include <PanelSequencer.h>
+
+namespace Soylent {
+    // Bulk transfers into the RAM of an SSD1681 panel controller
+    // GxEPD2 is sending image data byte by byte, here windows of rows are sent in chunks.
+    // Only the RAM access is done here, initializing and refreshing the panel is left to GxEPD2.
+    // The sequences of commands and bytes are put together by PanelSequencer, they are framed on the SPI bus here.
+    class PanelBus : public PanelSequencer<PanelBus> {
+    public:
+        // transfers since the last reset
+        struct panel_bus_stats
+        {
+            uint32_t bytes;
+            uint32_t transactions;
+        };
+
+        PanelBus(int16_t cs, int16_t dc);
+        void begin(SPIClass& spi, uint32_t clock);
+        void setClock(uint32_t clock);
+        uint32_t getClock();
+        panel_bus_stats getStats();
+        void resetStats();
+
+    private:
+        friend class PanelSequencer<PanelBus>;
+        void _writeCommand(uint8_t command, const uint8_t* data, size_t length);
+        void _startTransfer();
+        void _transfer(const uint8_t* data, size_t length);
+        void _endTransfer();
+        SPIClass* _spi;
+        SPISettings _settings;
+        uint32_t _clock;
+        int16_t _cs;
+        int16_t _dc;
+        panel_bus_stats _stats;
+    };
+} // namespace Soylent
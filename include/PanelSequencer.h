@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// maximum number of bytes sent in one SPI transfer
+#ifndef CONFIG_DISPLAY_SPI_CHUNK_BYTES
+    #define CONFIG_DISPLAY_SPI_CHUNK_BYTES 256
+#endif
+
+namespace Soylent {
+    // Commands and bytes for writing windows into the RAM of an SSD1681 panel controller
+    // The bytes are framed by the Link deriving from it (PanelBus on the SPI bus), which provides
+    // _writeCommand(command, data, length), _startTransfer(), _transfer(data, length) and _endTransfer().
+    // Kept free of Arduino dependencies, so the sequences can be checked against GxEPD2 on the host.
+    template <class Link>
+    class PanelSequencer {
+    public:
+        // RAM of the controller
+        enum RamPlane : uint8_t {
+            RAM_BLACK = 0x24,
+            RAM_RED = 0x26                  // 1 is red, it's inverted to the frames (0 is ink)
+        };
+
+        // Set the window of the controller's RAM and move the address counter to its start
+        // x increases, then y increases (same as GxEPD2_154_Z90c::_setPartialRamArea())
+        void setRamWindow(uint16_t xByte, uint16_t y, uint16_t widthBytes, uint16_t rows) {
+            uint16_t y_end = y + rows - 1;
+            const uint8_t entry_mode[] = { 0x03 };
+            const uint8_t x_range[] = { static_cast<uint8_t>(xByte), static_cast<uint8_t>(xByte + widthBytes - 1) };
+            const uint8_t y_range[] = { static_cast<uint8_t>(y % 256), static_cast<uint8_t>(y / 256),
+                                        static_cast<uint8_t>(y_end % 256), static_cast<uint8_t>(y_end / 256) };
+            const uint8_t x_counter[] = { static_cast<uint8_t>(xByte) };
+            const uint8_t y_counter[] = { static_cast<uint8_t>(y % 256), static_cast<uint8_t>(y / 256) };
+            _link()._writeCommand(0x11, entry_mode, sizeof(entry_mode));
+            _link()._writeCommand(0x44, x_range, sizeof(x_range));
+            _link()._writeCommand(0x45, y_range, sizeof(y_range));
+            _link()._writeCommand(0x4E, x_counter, sizeof(x_counter));
+            _link()._writeCommand(0x4F, y_counter, sizeof(y_counter));
+        }
+
+        // Write rows of a frame's plane into the current window of the controller's RAM
+        // rows are stride bytes apart in src, contiguous rows of the black plane are sent as they are
+        void writeRam(RamPlane plane, const uint8_t* src, uint16_t widthBytes, uint16_t rows, size_t stride) {
+            bool invert = plane == RAM_RED;
+            _link()._writeCommand(plane, nullptr, 0);
+            _link()._startTransfer();
+            if (widthBytes == stride && !invert) {
+                _link()._transfer(src, widthBytes * rows);
+            } else {
+                size_t fill = 0;
+                for (uint16_t row = 0; row < rows; row++) {
+                    const uint8_t* src_row = src + row * stride;
+                    for (uint16_t x = 0; x < widthBytes; x++) {
+                        _chunk[fill++] = invert ? ~src_row[x] : src_row[x];
+                        if (fill == sizeof(_chunk)) {
+                            _link()._transfer(_chunk, fill);
+                            fill = 0;
+                        }
+                    }
+                }
+                if (fill > 0)
+                    _link()._transfer(_chunk, fill);
+            }
+            _link()._endTransfer();
+        }
+
+    private:
+        Link& _link() {
+            return static_cast<Link&>(*this);
+        }
+        // buffer for gathering (and inverting) the bytes of a window before sending them
+        uint8_t _chunk[CONFIG_DISPLAY_SPI_CHUNK_BYTES];
+    };
+} // namespace Soylent
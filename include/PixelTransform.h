@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Transform kernel for 1-bit planes (MSB is the leftmost pixel)
+// Works on 32 bits at a time: a word is loaded, its bits are reversed within each byte
+// and the byte order is swapped, which mirrors 32 pixels in-register.
+// Kept free of Arduino dependencies, so it can be compiled on the host as well.
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "PixelTransform expects a little-endian target");
+
+namespace Soylent {
+    namespace PixelTransform {
+        enum Flags : uint8_t {
+            NONE = 0,
+            MIRROR_X = 1,   // mirror the pixels within each row
+            FLIP_Y = 2,     // reverse the order of rows
+            INVERT = 4      // invert all pixels
+        };
+
+        // reverse the bits within each byte of a word
+        inline uint32_t reverseBitsInBytes(uint32_t v) {
+            v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+            v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+            v = ((v >> 4) & 0x0F0F0F0Fu) | ((v & 0x0F0F0F0Fu) << 4);
+            return v;
+        }
+
+        // reverse all 32 bits of a word
+        inline uint32_t reverseBits(uint32_t v) {
+            return __builtin_bswap32(reverseBitsInBytes(v));
+        }
+
+        // reverse the bits of a single byte
+        inline uint8_t reverseBits(uint8_t v) {
+            return static_cast<uint8_t>(reverseBitsInBytes(v));
+        }
+
+        // copy a row of n bytes, mirroring its pixels: dst[n-1-i] = reverse(src[i])
+        inline void mirrorRow(uint8_t* __restrict dst, const uint8_t* __restrict src, size_t n, uint32_t xorMask = 0) {
+            uint8_t* d = dst + n;
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                uint32_t w;
+                memcpy(&w, src + i, 4);
+                w = reverseBits(w) ^ xorMask;
+                d -= 4;
+                memcpy(d, &w, 4);
+            }
+            for (; i < n; i++)
+                *--d = reverseBits(src[i]) ^ static_cast<uint8_t>(xorMask);
+        }
+
+        // copy a row of n bytes as is (optionally inverted)
+        inline void copyRow(uint8_t* __restrict dst, const uint8_t* __restrict src, size_t n, uint32_t xorMask = 0) {
+            if (xorMask == 0) {
+                memcpy(dst, src, n);
+                return;
+            }
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                uint32_t w;
+                memcpy(&w, src + i, 4);
+                w ^= xorMask;
+                memcpy(dst + i, &w, 4);
+            }
+            for (; i < n; i++)
+                dst[i] = src[i] ^ static_cast<uint8_t>(xorMask);
+        }
+
+        // transform rows of rowBytes bytes from src (with srcStride bytes per row, e.g. for 4-byte aligned bitmap rows)
+        // into dst (tightly packed), applying mirroring, row flip and inversion in a single pass
+        inline void transformRows(uint8_t* __restrict dst, const uint8_t* __restrict src,
+                                  size_t rows, size_t rowBytes, size_t srcStride, uint8_t flags) {
+            const uint32_t xorMask = (flags & INVERT) ? 0xFFFFFFFFu : 0;
+            for (size_t row = 0; row < rows; row++) {
+                const uint8_t* s = src + ((flags & FLIP_Y) ? rows - 1 - row : row) * srcStride;
+                uint8_t* d = dst + row * rowBytes;
+                if (flags & MIRROR_X)
+                    mirrorRow(d, s, rowBytes, xorMask);
+                else
+                    copyRow(d, s, rowBytes, xorMask);
+            }
+        }
+
+        // same as above, with the geometry of the rows known at compile time
+        // The loops over the words of a row have constant bounds, so they can be unrolled for a particular panel.
+        template <size_t RowBytes, size_t SrcStride>
+        inline void transformRows(uint8_t* __restrict dst, const uint8_t* __restrict src, size_t rows, uint8_t flags) {
+            static_assert(SrcStride >= RowBytes, "rows must fit into the stride");
+            constexpr size_t words = RowBytes / 4;
+            constexpr size_t tail = RowBytes % 4;
+            const uint32_t xorMask = (flags & INVERT) ? 0xFFFFFFFFu : 0;
+            const bool mirror = flags & MIRROR_X;
+            for (size_t row = 0; row < rows; row++) {
+                const uint8_t* s = src + ((flags & FLIP_Y) ? rows - 1 - row : row) * SrcStride;
+                uint8_t* d = dst + row * RowBytes;
+                if (mirror) {
+                    for (size_t i = 0; i < words; i++) {
+                        uint32_t w;
+                        memcpy(&w, s + 4 * i, 4);
+                        w = reverseBits(w) ^ xorMask;
+                        memcpy(d + RowBytes - 4 * (i + 1), &w, 4);
+                    }
+                    for (size_t i = 0; i < tail; i++)
+                        d[tail - 1 - i] = reverseBits(s[4 * words + i]) ^ static_cast<uint8_t>(xorMask);
+                } else {
+                    for (size_t i = 0; i < words; i++) {
+                        uint32_t w;
+                        memcpy(&w, s + 4 * i, 4);
+                        w ^= xorMask;
+                        memcpy(d + 4 * i, &w, 4);
+                    }
+                    for (size_t i = 0; i < tail; i++)
+                        d[4 * words + i] = s[4 * words + i] ^ static_cast<uint8_t>(xorMask);
+                }
+            }
+        }
+    } // namespace PixelTransform
+} // namespace Soylent
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <FS.h>
+
+// number of bytes read from the file at once
+#ifndef CONFIG_DISPLAY_DECODE_BUFFER
+    #define CONFIG_DISPLAY_DECODE_BUFFER 64
+#endif
+
+// size of the LZSS history, matches can refer this far back
+#define PLANE_DECODER_WINDOW 256
+
+namespace Soylent {
+    // Incremental decoder of a plane of a panel image (see tools/svg2rbmono.py)
+    // The plane is decoded in arbitrary pieces (e.g. band by band), while reading the file in small chunks.
+    // Several decoders can share a file, each one is seeking to its own position before reading.
+    class PlaneDecoder {
+    public:
+        enum Encoding : uint8_t {
+            RAW = 0,                    // uncompressed
+            RLE = 1,                    // PackBits: n < 128 copies n + 1 bytes, n > 128 repeats a byte 257 - n times
+            LZSS = 2                    // flag byte (LSB first, 1 = literal) followed by literals or (distance - 1, length - 3)
+        };
+
+        PlaneDecoder();
+        void begin(File& file, uint32_t offset, uint32_t size, Encoding encoding);
+        size_t read(uint8_t* dst, size_t length);
+
+    private:
+        int16_t _decode();
+        int16_t _next();
+        File* _file;
+        uint32_t _offset;               // position of the next chunk in the file
+        uint32_t _left;                 // bytes left in the file
+        Encoding _encoding;
+        uint8_t _input[CONFIG_DISPLAY_DECODE_BUFFER];
+        uint16_t _inputPos;
+        uint16_t _inputFill;
+        uint16_t _count;                // bytes left in the current run or match
+        bool _repeat;                   // RLE: repeating _value, otherwise copying literals
+        uint8_t _value;
+        uint8_t _flags;                 // LZSS: flags of the next eight items
+        uint8_t _flagBits;
+        uint16_t _distance;
+        uint8_t _window[PLANE_DECODER_WINDOW];
+        uint8_t _windowPos;
+    };
+} // namespace Soylent
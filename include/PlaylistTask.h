@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <TaskSchedulerDeclarations.h>
+#include <DisplayTask.h>
+
+// maximum number of images in the playlist
+#ifndef CONFIG_PLAYLIST_SIZE
+    #define CONFIG_PLAYLIST_SIZE 16
+#endif
+
+// shortest time an image is shown, in seconds (the panel takes ~15 seconds to refresh)
+#ifndef CONFIG_PLAYLIST_MIN_DWELL
+    #define CONFIG_PLAYLIST_MIN_DWELL 30
+#endif
+
+// retry, when the display wasn't available, in seconds
+#define PLAYLIST_RETRY_DELAY 5
+
+namespace Soylent {
+    // Images from the catalog, shown one after another for their dwell time
+    // The playlist is stored in NVS and resumed after a restart. While the panel is refreshing 
+    // for an image, the display worker is already reading the next one.
+    class PlaylistClass {
+    public:
+        struct playlist_item
+        {
+            char image_name[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];
+            uint32_t dwell_s;
+            int32_t img_idx;            // in the catalog, reported in the state of the display
+        };
+
+        PlaylistClass();
+        void begin(Scheduler* scheduler);
+        void end();
+        bool setItems(const playlist_item* items, size_t count);
+        size_t getCount();
+        bool getItem(size_t index, playlist_item& item);
+        size_t getPosition();
+        bool start();
+        void stop();
+        bool isRunning();
+
+    private:
+        void _playlistCallback();
+        void _load();
+        bool _save();
+        Task* _playlistTask;
+        Scheduler* _scheduler;
+        playlist_item _items[CONFIG_PLAYLIST_SIZE];
+        size_t _count;
+        size_t _position;               // index of the next image to show
+        bool _running;
+    };
+} // namespace Soylent
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+#include <Adafruit_GFX.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// number of text layouts kept for re-use
+#ifndef CONFIG_DISPLAY_TEXT_LAYOUT_CACHE
+    #define CONFIG_DISPLAY_TEXT_LAYOUT_CACHE 8
+#endif
+
+// number of lines a layout is prepared for (more lines are fine, yet need to allocate)
+#ifndef CONFIG_DISPLAY_TEXT_LAYOUT_LINES
+    #define CONFIG_DISPLAY_TEXT_LAYOUT_LINES 16
+#endif
+
+#define TEXT_FONT_INVALID 0xFF
+
+namespace Soylent {
+    enum class TextAlign : uint8_t {
+        LEFT,
+        CENTER,
+        RIGHT
+    };
+
+    enum class TextVAlign : uint8_t {
+        TOP,
+        MIDDLE,
+        BOTTOM
+    };
+
+    // Word-wrapping layout engine for GFX fonts
+    // Measured lines are cached by (text, font, box), so repeated renders skip measuring entirely.
+    // The entries of the cache are re-used, once grown they don't need to allocate again.
+    // Not thread-safe, it's meant to be used by the display worker only.
+    class TextLayout {
+    public:
+        struct text_line
+        {
+            uint16_t start;             // offset into glyphs
+            uint16_t length;            // number of glyphs
+            uint16_t width;             // width in pixels
+        };
+
+        struct text_layout
+        {
+            std::string text;           // source text (UTF-8)
+            uint8_t font_id;
+            uint8_t scale;
+            int16_t box_w;
+            int16_t box_h;
+            std::string glyphs;         // text mapped to the glyphs of the font
+            std::vector<text_line> lines;
+            int16_t ascent;             // pixels above the baseline
+            int16_t descent;            // pixels below the baseline
+            int16_t line_height;        // pixels from baseline to baseline
+            uint32_t last_used;         // 0 for unused entries
+        };
+
+        TextLayout(size_t textLength);
+        static uint8_t findFont(const char* name, uint8_t size);
+        static const GFXfont* getFont(uint8_t fontID);
+        const text_layout& layout(const char* text, uint8_t fontID, uint8_t scale, int16_t boxW, int16_t boxH);
+        void render(Adafruit_GFX& gfx, const text_layout& layout,
+                    int16_t boxX, int16_t boxY, TextAlign align, TextVAlign valign, uint16_t color);
+        void clear();
+
+    private:
+        static void _toGlyphs(const char* text, const GFXfont* font, std::string& glyphs);
+        static uint16_t _measure(const std::string& glyphs, size_t start, size_t length, const GFXfont* font, uint8_t scale);
+        static void _wrap(text_layout& layout, const GFXfont* font);
+        text_layout _cache[CONFIG_DISPLAY_TEXT_LAYOUT_CACHE];
+        uint32_t _uses;
+    };
+} // namespace Soylent
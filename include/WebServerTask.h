@@ -5,6 +5,7 @@
 #pragma once
 
 #include <TaskSchedulerDeclarations.h>
+#include <EmbeddedAssets.h>
 
 namespace Soylent {
     class WebServerClass {
@@ -19,5 +20,8 @@ namespace Soylent {
         StatusRequest _sr;
         Scheduler* _scheduler;
         AsyncWebServer* _webServer;
+        // asset found by the filter for the request, so it's looked up once (both run in the task of AsyncTCP)
+        const embedded_asset* _asset;
+        AsyncWebServerRequest* _assetRequest;
     };
 } // namespace Soylent
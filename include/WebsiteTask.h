@@ -5,6 +5,37 @@
 #pragma once
 
 #include <TaskSchedulerDeclarations.h>
+#include <ImageDitherer.h>
+#include <FrameBitmap.h>
+#include <ImageCatalog.h>
+#include <FileTags.h>
+#include <DisplayTask.h>
+#include <PlaylistTask.h>
+#include <string>
+#include <vector>
+
+// maximum length of the name of an uploaded image
+#ifndef CONFIG_WEBSITE_IMAGE_NAME_LENGTH
+    #define CONFIG_WEBSITE_IMAGE_NAME_LENGTH 32
+#endif
+
+// maximum size of an uploaded file
+#ifndef CONFIG_WEBSITE_UPLOAD_FILE_SIZE
+    #define CONFIG_WEBSITE_UPLOAD_FILE_SIZE 65536
+#endif
+
+// interval for checking the state of the panels, changes are pushed to /display/events (in ms)
+#ifndef CONFIG_WEBSITE_EVENTS_INTERVAL
+    #define CONFIG_WEBSITE_EVENTS_INTERVAL 250
+#endif
+
+// credentials for changing the content of LittleFS
+#ifndef WEBSITE_UPLOAD_USER
+    #define WEBSITE_UPLOAD_USER "admin"
+#endif
+#ifndef WEBSITE_UPLOAD_PASSWORD
+    #define WEBSITE_UPLOAD_PASSWORD APP_NAME
+#endif
 
 namespace Soylent {
     class WebSiteClass {
@@ -15,11 +46,37 @@ namespace Soylent {
 
     private:
         void _webSiteCallback();
+        void _displayEventsCallback();
+        static size_t _getDisplayEvent(int32_t panel, char* buffer, size_t size, uint32_t& version);
+        static constexpr size_t DISPLAY_EVENT_LENGTH = CONFIG_DISPLAY_STATE_LENGTH + 16;  // the state along with the panel's ID
+        static bool _isValidImageName(AsyncWebServerRequest* request);
+        void _releaseUpload();
+        static bool _isValidFileName(const String& fileName);
+        static bool _isAuthorized(AsyncWebServerRequest* request);
+        static int32_t _getPanelId(AsyncWebServerRequest* request);
+        static int32_t _getPanelId(JsonObject root);
+        static void _getTextStyle(JsonObject root, text_style& style);
+        void _releaseFileUpload(bool removeFiles);
+        bool _moveFileUpload();
+        bool _updateCatalog(const char* name, const char* image);
+        void _serveFile(AsyncWebServerRequest* request, const char* path);
         bool _fsMounted = false;
-        int32_t _imageIdx;
-        int32_t _imageCount;
-        JsonDocument* _imagesJson;
+        ImageCatalog _catalog;
+        PlaylistClass::playlist_item _playlistItems[CONFIG_PLAYLIST_SIZE];  // of a PUT /playlist, not on the stack
+        FileTags _fileTags;
         AsyncCallbackJsonWebHandler* _showImageHandler;
+        AsyncCallbackJsonWebHandler* _printTextHandler;
+        AsyncCallbackJsonWebHandler* _composeHandler;
+        AsyncCallbackJsonWebHandler* _playlistHandler;
+        AsyncEventSource* _displayEvents;
+        Task* _displayEventsTask;
+        uint32_t _displayVersions[CONFIG_DISPLAY_COUNT];    // versions of the state pushed last
+        ImageDitherer* _upload;
+        AsyncWebServerRequest* _uploadRequest;
+        AsyncWebServerRequest* _fileUploadRequest;
+        File _fileUpload;
+        std::vector<std::string> _fileUploadNames;
+        bool _fileUploadFailed;
         Scheduler* _scheduler;
         AsyncWebServer* _webServer;
     };
@@ -17,12 +17,15 @@
 #include <EventHandlerTask.h>
 #include <ESPConnectTask.h>
 #include <DisplayTask.h>
+#include <PlaylistTask.h>
 
 // in main.cpp
 extern Soylent::ESPRestartClass ESPRestart;
 extern Soylent::ESPConnectClass ESPConnect;
 extern Soylent::EventHandlerClass EventHandler;
-extern Soylent::DisplayClass Display;
+extern Soylent::PanelDisplayClass Display;
+extern Soylent::PanelDisplayClass* Displays[CONFIG_DISPLAY_COUNT];
+extern Soylent::PlaylistClass Playlist;
 extern Soylent::WebServerClass WebServer;
 extern Soylent::WebSiteClass WebSite;
 
@@ -30,38 +33,21 @@ extern Soylent::WebSiteClass WebSite;
 extern portMUX_TYPE cs_spinlock;
 
 namespace Soylent {
-    template <class Container>
-    void split_string(const std::string& str, Container& cont, const std::string& delims = " ")
+    // Allocate a (frame) buffer in PSRAM when present, in internal RAM otherwise
+    inline void* malloc_prefer_psram(size_t size)
     {
-        std::size_t current, previous = 0;
-        current = str.find_first_of(delims);
-        while (current != std::string::npos) {
-            cont.push_back(str.substr(previous, current - previous));
-            previous = current + 1;
-            current = str.find_first_of(delims, previous);
-        }
-        cont.push_back(str.substr(previous, current - previous));
+        void* buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+        return buffer != nullptr ? buffer : heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    };
+
+    // Move a (temporary) file into place on LittleFS, replacing an existing one
+    inline bool replace_file(const char* from, const char* to)
+    {
+        if (LittleFS.rename(from, to))
+            return true;
+        LittleFS.remove(to);
+        return LittleFS.rename(from, to);
     };
 }
 
-// Shorthands for Logging
-#ifdef EPAPER_DEBUG
-    #ifdef MYCILA_LOGGER_SUPPORT
-        #include <MycilaLogger.h>
-        extern Mycila::Logger logger;
-        #define LOGD(tag, format, ...) logger.debug(tag, format, ##__VA_ARGS__)
-        #define LOGI(tag, format, ...) logger.info(tag, format, ##__VA_ARGS__)
-        #define LOGW(tag, format, ...) logger.warn(tag, format, ##__VA_ARGS__)
-        #define LOGE(tag, format, ...) logger.error(tag, format, ##__VA_ARGS__)
-    #else
-        #define LOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
-        #define LOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
-        #define LOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
-        #define LOGE(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
-    #endif
-    #else
-        #define LOGD(tag, format, ...)
-        #define LOGI(tag, format, ...)
-        #define LOGW(tag, format, ...)
-        #define LOGE(tag, format, ...)
-#endif
+#include <Logging.h>
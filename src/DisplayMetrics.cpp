@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <ePaper.h>
+#include <DisplayMetrics.h>
+#define TAG "DisplayMetrics"
+
+Soylent::DisplayMetrics::DisplayMetrics()
+    : _job({})
+    , _jobStartUs(0)
+    , _prefetching(false)
+    , _next(0)
+    , _count(0) {
+}
+
+const char* Soylent::DisplayMetrics::getPhaseName(Phase phase) {
+    switch (phase) {
+        case QUEUE_WAIT:
+            return "queue_wait";
+        case FILE_READ:
+            return "file_read";
+        case DECODE:
+            return "decode";
+        case SPI_TRANSFER:
+            return "spi_transfer";
+        case REFRESH:
+            return "refresh";
+        case POWER_OFF:
+            return "power_off";
+        case PREFETCH:
+            return "prefetch";
+        default:
+            return "unknown";
+    }
+}
+
+// Start recording a job (in worker), the time spent in the queue is its first phase
+void Soylent::DisplayMetrics::beginJob(const char* command, int64_t enqueuedUs) {
+    _jobStartUs = enqueuedUs;
+    _job = {};
+    _job.command = command;
+    add(QUEUE_WAIT, enqueuedUs);
+}
+
+// Add the time passed since sinceUs to a phase of the current job (in worker)
+void Soylent::DisplayMetrics::add(Phase phase, int64_t sinceUs) {
+    _job.phase_us[_prefetching ? PREFETCH : phase] += static_cast<uint32_t>(esp_timer_get_time() - sinceUs);
+}
+
+// While prefetching, reading and decoding is done for the next job (in worker)
+void Soylent::DisplayMetrics::setPrefetching(bool prefetching) {
+    _prefetching = prefetching;
+}
+
+// Finish the current job and put it into the ring buffer (in worker)
+void Soylent::DisplayMetrics::endJob(uint32_t spiBytes, uint32_t spiTransfers) {
+    _job.total_us = static_cast<uint32_t>(esp_timer_get_time() - _jobStartUs);
+    _job.spi_bytes = spiBytes;
+    _job.spi_transfers = spiTransfers;
+
+    taskENTER_CRITICAL(&cs_spinlock);
+    _jobs[_next] = _job;
+    _next = (_next + 1) % CONFIG_DISPLAY_METRICS_SIZE;
+    if (_count < CONFIG_DISPLAY_METRICS_SIZE)
+        _count++;
+    taskEXIT_CRITICAL(&cs_spinlock);
+}
+
+// Get a recorded job, index 0 is the most recent one
+bool Soylent::DisplayMetrics::getJob(size_t index, job_metrics& job) {
+    bool found = false;
+    taskENTER_CRITICAL(&cs_spinlock);
+    if (index < _count) {
+        job = _jobs[(_next + CONFIG_DISPLAY_METRICS_SIZE - 1 - index) % CONFIG_DISPLAY_METRICS_SIZE];
+        found = true;
+    }
+    taskEXIT_CRITICAL(&cs_spinlock);
+    return found;
+}
+
+// Get min/avg/max of each phase over the recorded jobs, returns the number of jobs
+size_t Soylent::DisplayMetrics::getSummary(phase_summary* summary) {
+    uint64_t sum[PHASE_COUNT] = {};
+    for (uint8_t phase = 0; phase < PHASE_COUNT; phase++) {
+        summary[phase] = {UINT32_MAX, 0, 0};
+    }
+
+    taskENTER_CRITICAL(&cs_spinlock);
+    size_t count = _count;
+    for (size_t i = 0; i < count; i++) {
+        for (uint8_t phase = 0; phase < PHASE_COUNT; phase++) {
+            uint32_t value = _jobs[i].phase_us[phase];
+            summary[phase].min_us = std::min(summary[phase].min_us, value);
+            summary[phase].max_us = std::max(summary[phase].max_us, value);
+            sum[phase] += value;
+        }
+    }
+    taskEXIT_CRITICAL(&cs_spinlock);
+
+    for (uint8_t phase = 0; phase < PHASE_COUNT; phase++) {
+        if (count == 0) {
+            summary[phase].min_us = 0;
+        } else {
+            summary[phase].avg_us = sum[phase] / count;
+        }
+    }
+    return count;
+}
@@ -3,33 +3,96 @@
  * Copyright (C) 2024 Robert Wendlandt
  */
 #include <ePaper.h>
-#include "Fonts/FreeSans12pt7b.h"
+#include <esp_rom_crc.h>
+#include <PixelTransform.h>
+#include <Crc32.h>
+#include <FrameCanvas.h>
 #define TAG "Display"
 
-Soylent::DisplayClass::DisplayClass(SPIClass& spi)
-    : _display(GxEPD2_154_Z90c(DISPLAY_PIN_CS, DISPLAY_PIN_DC, DISPLAY_PIN_RST, DISPLAY_PIN_BUSY))
+template <class Panel>
+Soylent::DisplayClass<Panel>::DisplayClass(SPIClass& spi, const display_pins& pins)
+    : _pins(pins)
+    , _display(Panel(pins.cs, pins.dc, pins.rst, pins.busy))
     , _spi(&spi)
+    , _bus(pins.cs, pins.dc)
+    , _spiClock(std::min<uint32_t>(CONFIG_DISPLAY_SPI_CLOCK, panel_traits<Panel>::spi_clock_max))
     , _scheduler(nullptr)
-    , _text_color(GxEPD_BLACK)
-    , _text_content(APP_NAME)
-    , _image_name("") {    
+    , _commandQueue(nullptr)
+    , _workerTask(nullptr)
+    , _busyWaiter(nullptr)
+    , _pendingCommands(0)
+    , _frameCacheBudget(0)
+    , _frameCacheInvalid(false)
+    , _shadowFrame(nullptr)
+    , _composeFrame(nullptr)
+    , _shadowValid(false)
+    , _glassHash(0)
+    , _glassValid(false)
+    , _storedHash(0)
+    , _storedValid(false)
+    , _job(nullptr)
+    , _refreshing(false)
+    , _imageIdx(-1)
+    , _stateSnapshot{}
+    , _stateJson{}
+    , _stateLength(0)
+    , _stateVersion(esp_random())
+    , _prefetchFrame(nullptr)
+    , _prefetchName{}
+    , _prefetchPending{}
+    , _prefetchValid(false)
+    , _textLayout(CONFIG_DISPLAY_TEXT_LENGTH) {    
     _srBusy.setWaiting();
     _srInitialized.setWaiting();   
+
+    // panels are told apart by their CS pin in NVS
+    snprintf(_glassKey, sizeof(_glassKey), "glass%d", pins.cs);
 }
 
-void Soylent::DisplayClass::begin(Scheduler* scheduler) {
+template <class Panel>
+void Soylent::DisplayClass<Panel>::begin(Scheduler* scheduler) {
     yield();
 
     _srBusy.setWaiting();
     _srInitialized.setWaiting();
     _scheduler = scheduler;  
 
-    // Set up the async task params
-    _async_params.display = &_display;
-    _async_params.srBusy = &_srBusy;
-    _async_params.text_color = &_text_color;
-    _async_params.text_content = &_text_content;
-    _async_params.image_name = &_image_name;
+    // frames are cached in PSRAM when present, internal RAM is left to the network stack
+    _frameCacheBudget = psramFound() ? CONFIG_DISPLAY_FRAME_CACHE_SIZE : CONFIG_DISPLAY_FRAME_CACHE_SIZE_INTERNAL;
+
+    // allocate a frame for composing content and the shadow of the panel's RAM once
+    // ...in PSRAM when present, in internal RAM otherwise
+    // without the shadow, bands are written in full (and no refresh is skipped),
+    // without the frame for composing, only images can be shown (and the panel wiped)
+    if (_composeFrame == nullptr) {
+        _composeFrame = (uint8_t*) Soylent::malloc_prefer_psram(FRAME_BYTES);
+    }
+    if (_shadowFrame == nullptr) {
+        _shadowFrame = (uint8_t*) Soylent::malloc_prefer_psram(FRAME_BYTES);
+    }
+    if (_shadowFrame == nullptr || _composeFrame == nullptr) {
+        LOGE(TAG, "Out of memory for display frames, %s!", 
+             _composeFrame == nullptr ? "composing disabled" : "running without shadow");
+    }
+    _shadowValid = false;
+
+    // the spare frame for prefetching is optional, images are just read when shown without it
+    if (_prefetchFrame == nullptr) {
+        _prefetchFrame = (uint8_t*) Soylent::malloc_prefer_psram(FRAME_BYTES);
+    }
+    _prefetchValid = false;
+    _prefetchPending[0] = '\0';
+
+    // create the queue and the long-lived worker for display commands
+    // the worker is blocking on the queue until a command arrives
+    if (_commandQueue == nullptr) {
+        _commandQueue = xQueueCreate(CONFIG_DISPLAY_QUEUE_LENGTH, sizeof(display_command));
+    }
+    if (_workerTask == nullptr) {
+        xTaskCreate(_displayWorkerTask, "displayWorker", CONFIG_ASYNC_DISPLAY_STACK_SIZE, 
+                    (void*) this,
+                    tskIDLE_PRIORITY + 1, &_workerTask);
+    }
     
     // create and run a task for initializing the display
     Task* initializeDisplayTask = new Task(TASK_IMMEDIATE, TASK_ONCE, [&] { _initializeDisplayCallback(); }, 
@@ -39,18 +102,23 @@ void Soylent::DisplayClass::begin(Scheduler* scheduler) {
     LOGD(TAG, "Display is scheduled for start...");
 }
 
-void Soylent::DisplayClass::end() {
+template <class Panel>
+void Soylent::DisplayClass<Panel>::end() {
     LOGD(TAG, "Hibernate Display...");
     if (_srInitialized.completed()) {
         _display.hibernate();
+        detachInterrupt(digitalPinToInterrupt(_pins.busy));
+        _display.epd2.setBusyCallback(nullptr);
     }   
+    _shadowValid = false;
     _srBusy.setWaiting();
     _srInitialized.setWaiting(); 
     LOGD(TAG, "...done!");
 }
 
 // Initialize the display
-void Soylent::DisplayClass::_initializeDisplayCallback() {
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_initializeDisplayCallback() {
     LOGD(TAG, "Initialize Display...");
     #ifdef LED_BUILTIN
         pinMode(LED_BUILTIN, OUTPUT);
@@ -58,339 +126,1161 @@ void Soylent::DisplayClass::_initializeDisplayCallback() {
     #endif
 
     // set required display-pins as output
-    pinMode(DISPLAY_PIN_CS, OUTPUT);
-    digitalWrite(DISPLAY_PIN_CS, HIGH);
-    pinMode(DISPLAY_PIN_DC, OUTPUT);
-    pinMode(DISPLAY_PIN_RST, OUTPUT);
+    pinMode(_pins.cs, OUTPUT);
+    digitalWrite(_pins.cs, HIGH);
+    pinMode(_pins.dc, OUTPUT);
+    pinMode(_pins.rst, OUTPUT);
 
     // Initialize SPI and display
-    _spi->begin(DISPLAY_PIN_SPI_SCK, DISPLAY_PIN_SPI_MISO, DISPLAY_PIN_SPI_MOSI, DISPLAY_PIN_SPI_SS);
-    _display.init(0, true, 2, false, *_spi, SPISettings(4000000, MSBFIRST, SPI_MODE0));
-    _display.setRotation(2);
-    _display.setFont(&FreeSans12pt7b);
+    // ...a bus shared with another panel is only started once, transactions are serialized by SPIClass
+    _spi->begin(_pins.sck, _pins.miso, _pins.mosi, _pins.ss);
+    _display.init(0, true, 2, false, *_spi, SPISettings(_spiClock, MSBFIRST, SPI_MODE0));
+    _bus.begin(*_spi, _spiClock);
+    _display.setRotation(ROTATION);
+
+    // sleep instead of polling, while the panel is busy
+    _display.epd2.setBusyCallback(_busyCallback, this);
+    attachInterruptArg(digitalPinToInterrupt(_pins.busy), _busyISR, this, 
+                       panel_traits<Panel>::busy_level == HIGH ? FALLING : RISING);
 
     _srInitialized.signalComplete();
     LOGD(TAG, "...done!");
 
-    // create and run a task for creating and running an async task for wiping the display...
+    // the panel keeps its content without power, there is no need to wipe it when it's known
+    if (_loadGlassHash()) {
+        LOGD(TAG, "Panel content is known, skipping the wipe");
+        taskENTER_CRITICAL(&cs_spinlock);
+        if (_pendingCommands == 0) {
+            _srBusy.signalComplete();
+        }
+        taskEXIT_CRITICAL(&cs_spinlock);
+        return;
+    }
+
+    // let the worker wipe the display...
     LOGD(TAG, "Wiping Display...");
-    _wipeDisplayCallback();
+    display_command command = {};
+    command.type = CommandType::WIPE;
+    _enqueue(command);
 } 
 
-bool Soylent::DisplayClass::isInitialized() {
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::isInitialized() {
     return _srInitialized.completed();
 } 
 
-bool Soylent::DisplayClass::isBusy() {
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::isBusy() {
     return _srBusy.pending();
 } 
 
-void Soylent::DisplayClass::powerOff() {
+// Name of the command being processed by the worker (nullptr while idle)
+template <class Panel>
+const char* Soylent::DisplayClass<Panel>::getJob() {
+    return _job;
+}
+
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::isRefreshing() {
+    return _refreshing;
+}
+
+// Image of the website's catalog the panel is showing (-1 for anything else), it's part of the state
+template <class Panel>
+void Soylent::DisplayClass<Panel>::setImageIndex(int32_t imgIdx) {
+    _imageIdx = imgIdx;
+}
+
+// Version of the state, which is increased with every change
+template <class Panel>
+uint32_t Soylent::DisplayClass<Panel>::getStateVersion() {
+    _updateState();
+    taskENTER_CRITICAL(&cs_spinlock);
+    uint32_t version = _stateVersion;
+    taskEXIT_CRITICAL(&cs_spinlock);
+    return version;
+}
+
+// State of the panel as json, along with its version
+// it is rendered only when it changed, not for every request
+template <class Panel>
+size_t Soylent::DisplayClass<Panel>::getState(char* buffer, size_t size, uint32_t& version) {
+    _updateState();
+    taskENTER_CRITICAL(&cs_spinlock);
+    size_t length = std::min(_stateLength, size - 1);
+    memcpy(buffer, _stateJson, length);
+    version = _stateVersion;
+    taskEXIT_CRITICAL(&cs_spinlock);
+    buffer[length] = '\0';
+    return length;
+}
+
+template <class Panel>
+void Soylent::DisplayClass<Panel>::powerOff() {
     if (_srInitialized.pending()) return;
     _display.powerOff();
 } 
 
-void Soylent::DisplayClass::hibernate() {
+template <class Panel>
+void Soylent::DisplayClass<Panel>::hibernate() {
     if (_srInitialized.pending()) return;
     _display.hibernate();
-}
-
-// Wipe the display in async task
-void Soylent::DisplayClass::_async_wipeDisplayTask(void* pvParameters) {
-    auto params = static_cast<Soylent::DisplayClass::async_params*>(pvParameters);
-
-    // display was flagged as busy externally...
-    #ifdef LED_BUILTIN
-        digitalWrite(LED_BUILTIN, HIGH);
-    #endif
 
-    params->display->clearScreen();
-    params->display->powerOff();
-
-    #ifdef LED_BUILTIN
-        digitalWrite(LED_BUILTIN, LOW);
-    #endif
+    // the panel's RAM can't be trusted after waking up again
+    _shadowValid = false;
+}
 
+// Pass a command to the display worker
+// the display is flagged as busy until all pending commands are processed
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::_enqueue(display_command& command) {
+    command.enqueued_us = esp_timer_get_time();
     taskENTER_CRITICAL(&cs_spinlock);
-    params->srBusy->signalComplete();
-    taskEXIT_CRITICAL(&cs_spinlock);    
+    _pendingCommands++;
+    _srBusy.setWaiting();
+    taskEXIT_CRITICAL(&cs_spinlock);
+
+    if (xQueueSend(_commandQueue, &command, 0) != pdTRUE) {
+        LOGW(TAG, "Display queue is full, dropping command!");
+        taskENTER_CRITICAL(&cs_spinlock);
+        if (--_pendingCommands == 0) {
+            _srBusy.signalComplete();
+        }
+        taskEXIT_CRITICAL(&cs_spinlock);
+        return false;
+    }
 
-    vTaskDelete(NULL);
+    return true;
 }
 
-void Soylent::DisplayClass::_wipeDisplayCallback() {
-    _srBusy.setWaiting();
-    xTaskCreate(_async_wipeDisplayTask, "wipeDisplayTask", configMINIMAL_STACK_SIZE, 
-                (void*) &_async_params,
-                tskIDLE_PRIORITY + 1, NULL);
-    
-    #ifdef DEBUG_ASYNC_TASK
-        // Just for debugging...
-        Task* report_async_wipeDisplayTask = new Task(TASK_IMMEDIATE, TASK_ONCE, 
-            [&] { LOGD(TAG, "...async wiping done!"); }, _scheduler, false, NULL, NULL, true);   
-        report_async_wipeDisplayTask->enable();
-        report_async_wipeDisplayTask->waitFor(&_srBusy);
-    #endif
+// Commands replacing the whole content of the display can be coalesced:
+// when they pile up while the panel is busy, only the latest one is shown 
+// ...a wipe is never dropped (nor is it dropping others), it's clearing the panel of ghosting as well
+// (no default, so the compiler is asking for new types to be listed here)
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::_isLatestWins(CommandType type) {
+    switch (type) {
+        case CommandType::WIPE:
+            return false;
+        case CommandType::PRINT_TAG:
+        case CommandType::PRINT_TEXT:
+        case CommandType::SHOW_IMAGE:
+        case CommandType::COMPOSE:
+            return true;
+    }
+    return false;
 }
 
-void Soylent::DisplayClass::wipeDisplay() {
-    if (_srInitialized.pending()) {
-        LOGW(TAG, "uninitialized, can't do it!");
-        return;
+// Called by GxEPD2 while waiting for the panel (instead of delay(1))
+// the calling task is blocked until the BUSY line is released (or the wait times out)
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_busyCallback(const void* pvParameters) {
+    auto display = static_cast<Soylent::DisplayClass<Panel>*>(const_cast<void*>(pvParameters));
+    // the next image is read while the panel is refreshing (once)
+    if (display->_prefetchPending[0] != '\0') {
+        display->_prefetchImage();
+    }
+    display->_busyWaiter = xTaskGetCurrentTaskHandle();
+    if (digitalRead(display->_pins.busy) == panel_traits<Panel>::busy_level) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_DISPLAY_BUSY_WAIT_MS));
     }
+    display->_busyWaiter = nullptr;
+}
 
-    // create and run a task for creating and running an async task for wiping the display...
-    // task is pending until the display is not busy
-    LOGD(TAG, "Start wiping...");
-    Task* wipeDisplayTask = new Task(TASK_IMMEDIATE, TASK_ONCE, [&] { _wipeDisplayCallback(); }, 
-        _scheduler, false, NULL, NULL, true);   
-    wipeDisplayTask->enable();
-    wipeDisplayTask->waitFor(&_srBusy);
+// Wake the task waiting for the panel, when the BUSY line is released
+template <class Panel>
+void IRAM_ATTR Soylent::DisplayClass<Panel>::_busyISR(void* pvParameters) {
+    auto display = static_cast<Soylent::DisplayClass<Panel>*>(pvParameters);
+    TaskHandle_t waiter = display->_busyWaiter;
+    if (waiter != nullptr) {
+        BaseType_t higherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(waiter, &higherPriorityTaskWoken);
+        portYIELD_FROM_ISR(higherPriorityTaskWoken);
+    }
 }
 
-void Soylent::DisplayClass::_async_printCenteredTextTask(void* pvParameters) {
-    auto params = static_cast<Soylent::DisplayClass::async_params*>(pvParameters);
+// Long-lived worker for processing display commands
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_displayWorkerTask(void* pvParameters) {
+    auto display = static_cast<Soylent::DisplayClass<Panel>*>(pvParameters);
+    display_command command;
 
-    // display was flagged as busy externally...
-    #ifdef LED_BUILTIN
-        digitalWrite(LED_BUILTIN, HIGH);
-    #endif
+    while (true) {
+        if (xQueueReceive(display->_commandQueue, &command, portMAX_DELAY) != pdTRUE)
+            continue;
 
-    // a blank image (with text...)
-    params->display->setTextColor(*params->text_color);    
-    int16_t tbx, tby; uint16_t tbw, tbh;
-    params->display->getTextBounds(params->text_content->c_str(), 0, 0, &tbx, &tby, &tbw, &tbh);
-    
-    // center bounding box by transposition of origin:
-    uint16_t x = ((params->display->width() - tbw) / 2) - tbx;
-    uint16_t y = ((params->display->height() - tbh) / 2) - tby;
-    params->display->firstPage();
-    do {
-        params->display->fillScreen(GxEPD_WHITE);
-        params->display->setCursor(x, y);
-        params->display->print(params->text_content->c_str());
-    } while (params->display->nextPage());
-
-    params->display->powerOff();
+        // skip commands which are superseded by newer ones
+        uint32_t processed = 1;
+        display_command next;
+        while (_isLatestWins(command.type) && 
+               xQueuePeek(display->_commandQueue, &next, 0) == pdTRUE &&
+               _isLatestWins(next.type)) {
+            xQueueReceive(display->_commandQueue, &command, 0);
+            processed++;
+        }
+        #ifdef DEBUG_ASYNC_TASK
+            if (processed > 1) {
+                LOGD(TAG, "Coalesced %" PRIu32 " commands", processed);
+            }
+        #endif
 
-    #ifdef LED_BUILTIN
-        digitalWrite(LED_BUILTIN, LOW);
-    #endif
+        // apply changes of the frame cache
+        if (display->_frameCacheInvalid.exchange(false)) {
+            display->_frameCache.clear();
+            display->_prefetchValid = false;
+        }
+        if (display->_frameCache.getBudget() != display->_frameCacheBudget) {
+            display->_frameCache.setBudget(display->_frameCacheBudget);
+        }
 
-    taskENTER_CRITICAL(&cs_spinlock);
-    params->srBusy->signalComplete();
-    taskEXIT_CRITICAL(&cs_spinlock);    
+        // apply changes of the SPI clock (for GxEPD2 as well)
+        uint32_t spi_clock = display->_spiClock;
+        if (display->_bus.getClock() != spi_clock) {
+            display->_bus.setClock(spi_clock);
+            display->_display.epd2.selectSPI(*display->_spi, SPISettings(spi_clock, MSBFIRST, SPI_MODE0));
+        }
+        display->_bus.resetStats();
+        display->_metrics.beginJob(_getCommandName(command.type), command.enqueued_us);
+        #ifdef DEBUG_ASYNC_TASK
+            // processing is meant to be free of allocations, once the caches are filled
+            size_t heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        #endif
+
+        #ifdef LED_BUILTIN
+            digitalWrite(LED_BUILTIN, HIGH);
+        #endif
+        display->_job = _getCommandName(command.type);
 
-    vTaskDelete(NULL);
+        switch (command.type) {
+            case CommandType::WIPE:
+                display->_wipeDisplay();
+                break;
+            case CommandType::PRINT_TAG:
+                display->_printCenteredText(command.tag_id);
+                break;
+            case CommandType::PRINT_TEXT:
+                display->_printText(command.text, command.style);
+                break;
+            case CommandType::SHOW_IMAGE:
+                display->_showImage(command.image_name, command.next_image_name);
+                break;
+            case CommandType::COMPOSE:
+                display->_compose(command);
+                break;
+        }
+
+        display->_job = nullptr;
+        #ifdef LED_BUILTIN
+            digitalWrite(LED_BUILTIN, LOW);
+        #endif
+
+        PanelBus::panel_bus_stats stats = display->_bus.getStats();
+        display->_metrics.endJob(stats.bytes, stats.transactions);
+        #ifdef DEBUG_ASYNC_TASK
+            LOGD(TAG, "...async command done! (%" PRIu32 " bytes in %" PRIu32 " SPI transfers)", stats.bytes, stats.transactions);
+            // ...other tasks may have (de-)allocated in the meantime
+            int32_t heap_delta = static_cast<int32_t>(heap_caps_get_free_size(MALLOC_CAP_8BIT)) - static_cast<int32_t>(heap_free);
+            if (heap_delta != 0) {
+                LOGW(TAG, "Heap changed by %" PRId32 " bytes while processing", heap_delta);
+            }
+        #endif
+
+        taskENTER_CRITICAL(&cs_spinlock);
+        display->_pendingCommands -= processed;
+        if (display->_pendingCommands == 0) {
+            display->_srBusy.signalComplete();
+        }
+        taskEXIT_CRITICAL(&cs_spinlock);
+    }
 }
 
-void Soylent::DisplayClass::_printCenteredTextCallback() {
-    _srBusy.setWaiting();
-    xTaskCreate(_async_printCenteredTextTask, "printCenteredTextTask", configMINIMAL_STACK_SIZE, 
-                (void*) &_async_params,
-                tskIDLE_PRIORITY + 1, NULL);
-    
-    #ifdef DEBUG_ASYNC_TASK
-        // Just for debugging...
-        Task* report_async_printCenteredTextTask = new Task(TASK_IMMEDIATE, TASK_ONCE, 
-            [&] { LOGD(TAG, "...async printing done!"); }, _scheduler, false, NULL, NULL, true);   
-        report_async_printCenteredTextTask->enable();
-        report_async_printCenteredTextTask->waitFor(&_srBusy);
-    #endif
+// Wipe the display (in worker)
+// when the panel's RAM is known, only the non-white windows are cleared
+// ...and nothing is refreshed, when the panel is blank already
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_wipeDisplay() {
+    if (_composeFrame != nullptr) {
+        memset(_composeFrame, 0xFF, FRAME_BYTES);
+        _pushFrame(_composeFrame);
+    } else {
+        memset(_bandBlack, 0xFF, BAND_BYTES);
+        memset(_bandRed, 0xFF, BAND_BYTES);
+        for (uint16_t y = 0; y < HEIGHT; y += CONFIG_DISPLAY_BAND_ROWS) {
+            _pushBand(y, std::min<uint16_t>(CONFIG_DISPLAY_BAND_ROWS, HEIGHT - y), _bandBlack, _bandRed);
+        }
+    }
+    _refreshPanel();
+    _powerOffPanel();
 }
 
-void Soylent::DisplayClass::printCenteredTag(uint16_t tagID = NAME_TAG_BLACK) {
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::wipeDisplay() {
     if (_srInitialized.pending()) {
         LOGW(TAG, "uninitialized, can't do it!");
-        return;
+        return false;
     }
 
-    // Store text-content and -color in the async_params struct
-    _text_content = APP_NAME;
-    _text_color = GxEPD_BLACK;
+    LOGD(TAG, "Start wiping...");
+    display_command command = {};
+    command.type = CommandType::WIPE;
+    return _enqueue(command);
+}
+
+// Print a centered tag (in worker)
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_printCenteredText(uint16_t tagID) {
+    const char* text_content = APP_NAME;
+    text_style style = {};
+    style.font_id = Soylent::TextLayout::findFont("sans", 12);
+    style.scale = 1;
+    style.align = TextAlign::CENTER;
+    style.valign = TextVAlign::MIDDLE;
+    style.color = GxEPD_BLACK;
+    style.box_w = _display.width();
+    style.box_h = _display.height();
 
     switch (tagID) {
         case BLANK_TEXT:
-            _text_content = "";
-            _text_color = GxEPD_WHITE;
+            text_content = "";
+            break;
         case NAME_TAG_RED:
-            _text_color = GxEPD_RED;
+            style.color = GxEPD_RED;
             break;
         default:
             break;
     }
 
-    // create and run a task for creating and running an async task for printing on the display...
-    // task is pending until the display is not busy
-    LOGD(TAG, "Start printing: %s", _text_content.c_str());
-    Task* printTask = new Task(TASK_IMMEDIATE, TASK_ONCE, [&] { _printCenteredTextCallback(); }, 
-        _scheduler, false, NULL, NULL, true);   
-    printTask->enable();
-    printTask->waitFor(&_srBusy);
+    _printText(text_content, style);
 }
 
-static unsigned char lookup[16] = {
-0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
-0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf, };
+// Print a text (in worker)
+// the layout of the text is cached, so re-printing a text doesn't need to measure it again
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_printText(const char* text, const text_style& style) {
+    if (_composeFrame == nullptr)
+        return;
+
+    // compose a blank image with the text off-screen
+    int64_t start = esp_timer_get_time();
+    FrameCanvas canvas(_composeFrame, WIDTH, HEIGHT);
+    canvas.setRotation(_display.getRotation());
+    canvas.fillScreen(GxEPD_WHITE);
+    const auto& layout = _textLayout.layout(text, style.font_id, style.scale, style.box_w, style.box_h);
+    _textLayout.render(canvas, layout, style.box_x, style.box_y, style.align, style.valign, style.color);
+    _metrics.add(DisplayMetrics::DECODE, start);
 
-uint8_t reverse(uint8_t n) {
-   // Reverse the top and bottom nibble then swap them.
-   return (lookup[n&0b1111] << 4) | lookup[n>>4];
+    // write what has changed and refresh
+    _pushFrame(_composeFrame);
+    _refreshPanel();
+    _powerOffPanel();
 }
 
-void reverse_pxcpy(uint8_t *__restrict dst, const uint8_t *__restrict src, size_t n)
-{
-    for (size_t i = 0; i < n; i++)
-        dst[n-1-i] = reverse(src[i]);
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::printCenteredTag(uint16_t tagID) {
+    if (_srInitialized.pending()) {
+        LOGW(TAG, "uninitialized, can't do it!");
+        return false;
+    }
+
+    if (_composeFrame == nullptr) {
+        LOGW(TAG, "No frame for composing!");
+        return false;
+    }
+
+    LOGD(TAG, "Start printing: %d", tagID);
+    display_command command = {};
+    command.type = CommandType::PRINT_TAG;
+    command.tag_id = tagID;
+    return _enqueue(command);
 }
 
-void Soylent::DisplayClass::_async_showImageTask(void* pvParameters) {
-    auto params = static_cast<Soylent::DisplayClass::async_params*>(pvParameters);
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::printText(const char* text, const text_style& style) {
+    if (_srInitialized.pending()) {
+        LOGW(TAG, "uninitialized, can't do it!");
+        return false;
+    }
 
-    // display was flagged as busy externally...
-    #ifdef LED_BUILTIN
-        digitalWrite(LED_BUILTIN, HIGH);
-    #endif
+    if (_composeFrame == nullptr) {
+        LOGW(TAG, "No frame for composing!");
+        return false;
+    }
+
+    if (Soylent::TextLayout::getFont(style.font_id) == nullptr || 
+        style.scale == 0 || style.box_w <= 0 || style.box_h <= 0 ||
+        (style.color != GxEPD_BLACK && style.color != GxEPD_RED)) {
+        LOGW(TAG, "Invalid text style");
+        return false;
+    }
+
+    // copy the text into the command, so it can't be changed while being processed
+    display_command command = {};
+    command.type = CommandType::PRINT_TEXT;
+    command.style = style;
+    if (strlcpy(command.text, text, sizeof(command.text)) >= sizeof(command.text)) {
+        LOGW(TAG, "Text too long");
+        return false;
+    }
+
+    LOGD(TAG, "Start printing: %s", command.text);
+    return _enqueue(command);
+}
+
+// Write a band of rows to the panel's RAM
+// only the window of bytes that differs from the shadow of the panel's RAM is transferred
+// ...without a shadow (never valid then), the band is written in full by GxEPD2
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_pushBand(uint16_t y, uint16_t rows, const uint8_t* black, const uint8_t* red) {
+    uint8_t* shadow_black = _shadowFrame != nullptr ? _shadowFrame + y * ROW_BYTES : nullptr;
+    uint8_t* shadow_red = _shadowFrame != nullptr ? _shadowFrame + PLANE_BYTES + y * ROW_BYTES : nullptr;
+    size_t band_size = rows * ROW_BYTES;
+
+    // find the bounding window of changed bytes
+    int64_t start = esp_timer_get_time();
+    int16_t x_first = 0;
+    int16_t x_last = ROW_BYTES - 1;
+    if (_shadowValid) {
+        x_first = ROW_BYTES;
+        x_last = -1;
+        for (uint16_t row = 0; row < rows; row++) {
+            size_t offset = row * ROW_BYTES;
+            if (memcmp(black + offset, shadow_black + offset, ROW_BYTES) == 0 &&
+                memcmp(red + offset, shadow_red + offset, ROW_BYTES) == 0)
+                continue;
+            for (int16_t x = 0; x < x_first; x++) {
+                if (black[offset + x] != shadow_black[offset + x] || red[offset + x] != shadow_red[offset + x]) {
+                    x_first = x;
+                    break;
+                }
+            }
+            for (int16_t x = ROW_BYTES - 1; x > x_last; x--) {
+                if (black[offset + x] != shadow_black[offset + x] || red[offset + x] != shadow_red[offset + x]) {
+                    x_last = x;
+                    break;
+                }
+            }
+        }
+    }
+    _metrics.add(DisplayMetrics::DECODE, start);
+
+    // nothing has changed
+    if (x_last < x_first)
+        return;
+
+    // while the shadow is valid, the controller is known to be initialized and the window is sent in bulk
+    // ...otherwise (or for panels unknown to PanelBus) GxEPD2 is taking care of (re-)initializing the controller
+    start = esp_timer_get_time();
+    if (panel_traits<Panel>::bulk_ram && _shadowValid) {
+        uint16_t width_bytes = x_last - x_first + 1;
+        _bus.setRamWindow(x_first, y, width_bytes, rows);
+        _bus.writeRam(PanelBus::RAM_BLACK, black + x_first, width_bytes, rows, ROW_BYTES);
+        _bus.setRamWindow(x_first, y, width_bytes, rows);
+        _bus.writeRam(PanelBus::RAM_RED, red + x_first, width_bytes, rows, ROW_BYTES);
+    } else {
+        _display.writeImagePart(black, red, 
+                                x_first * 8, 0, WIDTH, rows, 
+                                x_first * 8, y, (x_last - x_first + 1) * 8, rows,
+                                false, false, false);
+    }
+    _metrics.add(DisplayMetrics::SPI_TRANSFER, start);
+    if (_shadowFrame == nullptr)
+        return;
+    memcpy(shadow_black, black, band_size);
+    memcpy(shadow_red, red, band_size);
+}
+
+// Write a full frame to the panel's RAM, only the changed windows are transferred
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_pushFrame(const uint8_t* frame) {
+    for (uint16_t y = 0; y < HEIGHT; y += CONFIG_DISPLAY_BAND_ROWS) {
+        uint16_t rows = std::min<uint16_t>(CONFIG_DISPLAY_BAND_ROWS, HEIGHT - y);
+        _pushBand(y, rows, 
+                  frame + y * ROW_BYTES, 
+                  frame + PLANE_BYTES + y * ROW_BYTES);
+    }
+    _shadowValid = _shadowFrame != nullptr;
+}
+
+// Open a panel-native image (see tools/svg2rbmono.py) and prepare the decoders of both planes
+// only the container is checked here, the size is up to the caller
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::_beginPanelImage(const char* baseName, File& file, EPDIMAGEHEADER& epdHeader) {
+    char file_name[PATH_LENGTH];
+    int64_t start = esp_timer_get_time();
+    if (!_getFileName(file_name, baseName, ".epd") || !LittleFS.exists(file_name)) {
+        _metrics.add(DisplayMetrics::FILE_READ, start);
+        return false;
+    }
+
+    file = LittleFS.open(file_name, "r");
+    size_t header_size = file.read((uint8_t*) &epdHeader, sizeof(epdHeader));
+    _metrics.add(DisplayMetrics::FILE_READ, start);
+    if (header_size != sizeof(epdHeader) ||
+        epdHeader.eMagic != EPD_IMAGE_MAGIC || 
+        epdHeader.eVersion != EPD_IMAGE_VERSION ||
+        epdHeader.eRotation != ROTATION ||
+        (epdHeader.eFlags & ~EPD_IMAGE_FLAG_ENCODING) != 0 ||
+        (epdHeader.eFlags & EPD_IMAGE_FLAG_ENCODING) == EPD_IMAGE_FLAG_ENCODING) {
+        LOGE(TAG, "%s is not a panel image!", file_name);
+        file.close();
+        return false;
+    }
+
+    // locate the planes, compressed planes are preceded by the size of the black one
+    uint32_t offset_black = sizeof(epdHeader);
+    uint32_t size_black = epdHeader.ePlaneSize;
+    PlaneDecoder::Encoding encoding = PlaneDecoder::RAW;
+    if (epdHeader.eFlags & EPD_IMAGE_FLAG_ENCODING) {
+        encoding = (epdHeader.eFlags & EPD_IMAGE_FLAG_RLE) ? PlaneDecoder::RLE : PlaneDecoder::LZSS;
+        offset_black += sizeof(size_black);
+        if (file.read((uint8_t*) &size_black, sizeof(size_black)) != sizeof(size_black) ||
+            offset_black + size_black > file.size()) {
+            LOGE(TAG, "%s is corrupted!", file_name);
+            file.close();
+            return false;
+        }
+    }
+    uint32_t offset_red = offset_black + size_black;
+    _decoderBlack.begin(file, offset_black, size_black, encoding);
+    _decoderRed.begin(file, offset_red, file.size() - offset_red, encoding);
+    return true;
+}
+
+// Write a panel-native image (see tools/svg2rbmono.py) to the panel's RAM
+// both planes are stored in the byte order of the panel's RAM, no transformation needed
+// ...they are decoded and streamed band by band to the panel (and copied to frame, if given)
+// ...or just into frame, when not written toPanel
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::_writePanelImage(const char* baseName, uint8_t* frame, bool toPanel) {
+    File file;
+    Soylent::EPDIMAGEHEADER epdHeader;
+    if (!_beginPanelImage(baseName, file, epdHeader))
+        return false;
+
+    // check that the image is matching the panel
+    const uint32_t plane_size = PLANE_BYTES;
+    if (epdHeader.eWidth != WIDTH || 
+        epdHeader.eHeight != HEIGHT ||
+        epdHeader.ePlaneSize != plane_size) {
+        LOGE(TAG, "%s is not matching the panel!", baseName);
+        file.close();
+        return false;
+    }
 
-    // open images to show
-    std::vector<std::string> tokenized_imageName;
-    Soylent::split_string(params->image_name->c_str(), tokenized_imageName, "/.");
-    std::string file_name_red = "/" + tokenized_imageName[tokenized_imageName.size() - 2] + ".r.bmp";
-    std::string file_name_black = "/" + tokenized_imageName[tokenized_imageName.size() - 2] + ".b.bmp";
+    // stream both planes, band by band
+    // the crc is computed for each plane and combined at the end
+    uint32_t crc_black = 0;
+    uint32_t crc_red = 0;
+    for (uint16_t y = 0; y < epdHeader.eHeight; y += CONFIG_DISPLAY_BAND_ROWS) {
+        uint16_t rows = std::min<uint16_t>(CONFIG_DISPLAY_BAND_ROWS, epdHeader.eHeight - y);
+        size_t band_size = rows * ROW_BYTES;
+        int64_t start = esp_timer_get_time();
+        bool complete = _decoderBlack.read(_bandBlack, band_size) == band_size;
+        complete = complete && _decoderRed.read(_bandRed, band_size) == band_size;
+        _metrics.add(DisplayMetrics::FILE_READ, start);
+        if (!complete) break;
+        start = esp_timer_get_time();
+        crc_black = esp_rom_crc32_le(crc_black, _bandBlack, band_size);
+        crc_red = esp_rom_crc32_le(crc_red, _bandRed, band_size);
+        if (frame != nullptr) {
+            memcpy(frame + y * ROW_BYTES, _bandBlack, band_size);
+            memcpy(frame + plane_size + y * ROW_BYTES, _bandRed, band_size);
+        }
+        _metrics.add(DisplayMetrics::DECODE, start);
+        if (toPanel) {
+            _pushBand(y, rows, _bandBlack, _bandRed);
+        }
+    }
+    file.close();
+
+    // the image is only usable, when it was read completely
+    if (Soylent::Crc32::combine(crc_black, crc_red, plane_size) != epdHeader.eChecksum) {
+        LOGE(TAG, "%s is corrupted!", baseName);
+        return false;
+    }
+
+    return true;
+}
+
+// Write an image from a pair of bitmaps (legacy) to the panel's RAM
+// bitmap rows are stored bottom-up, which is matching the panel's RAM for _display.setRotation(ROTATION)
+// ...so the rows are streamed in file order and only the pixels within a row need to be mirrored
+// ...or just into frame, when not written toPanel
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::_writeBitmapImage(const char* baseName, uint8_t* frame, bool toPanel) {
+    char file_name_red[PATH_LENGTH];
+    char file_name_black[PATH_LENGTH];
+    int64_t start = esp_timer_get_time();
+    if (!_getFileName(file_name_red, baseName, ".r.bmp") || !_getFileName(file_name_black, baseName, ".b.bmp") ||
+        !LittleFS.exists(file_name_red) || !LittleFS.exists(file_name_black)) {
+        _metrics.add(DisplayMetrics::FILE_READ, start);
+        return false;
+    }
 
     // open red file and get info
-    File file_red = LittleFS.open(file_name_red.c_str(), "r");
-    Soylent::DisplayClass::BITMAPFILEHEADER bmpFileHeader_red;
-    Soylent::DisplayClass::BITMAPINFOHEADER bmpInfoHeader_red; 
+    File file_red = LittleFS.open(file_name_red, "r");
+    Soylent::BITMAPFILEHEADER bmpFileHeader_red;
+    Soylent::BITMAPINFOHEADER bmpInfoHeader_red; 
     file_red.seek(0, fs::SeekMode::SeekSet);   
     file_red.read((uint8_t*) &bmpFileHeader_red, sizeof(bmpFileHeader_red));
     file_red.read((uint8_t*) &bmpInfoHeader_red, sizeof(bmpInfoHeader_red));
 
-    // malloc a buffer for the bitmap part, which is oversized for the raw pixels
-    // ...as the bitmap pixel data is aligned by 4 bytes
-    uint8_t* buf_file = (uint8_t*) ps_malloc(bmpInfoHeader_red.biImageSize);
-
-    // read the bitmap part from file
-    file_red.seek(bmpFileHeader_red.bOffset, fs::SeekMode::SeekSet);   
-    file_red.read(buf_file, bmpInfoHeader_red.biImageSize);
-    file_red.close();
-
-    // malloc a buffer for the red pixel data
-    // ...and copy the raw pixel data
-    auto bitmap_size = (bmpInfoHeader_red.biWidth * bmpInfoHeader_red.biHeight * bmpInfoHeader_red.biBitCount) / 8;
-    auto row_width_pixel = (bmpInfoHeader_red.biWidth * bmpInfoHeader_red.biBitCount) / 8;
-    auto row_width_bmp = (bmpInfoHeader_red.biWidth * bmpInfoHeader_red.biBitCount) / 8;
-    row_width_bmp += (row_width_bmp % 4) == 0 ? 0 : 4 - (row_width_bmp % 4);
-    uint8_t* bitmap_red = (uint8_t*) ps_malloc(bitmap_size);
-    // copy pixels to match _display.setRotation(2);
-    for (int32_t row = 0; row < bmpInfoHeader_red.biHeight; row++) {
-        reverse_pxcpy(bitmap_red + row * row_width_pixel,
-            buf_file + (bmpInfoHeader_red.biHeight - row) * row_width_bmp, 
-            row_width_pixel);
-    }
-
-    // repeat for black image
-    File file_black = LittleFS.open(file_name_black.c_str(), "r");
-    Soylent::DisplayClass::BITMAPFILEHEADER bmpFileHeader_black;
-    Soylent::DisplayClass::BITMAPINFOHEADER bmpInfoHeader_black; 
+    // open black file and get info
+    File file_black = LittleFS.open(file_name_black, "r");
+    Soylent::BITMAPFILEHEADER bmpFileHeader_black;
+    Soylent::BITMAPINFOHEADER bmpInfoHeader_black; 
     file_black.seek(0, fs::SeekMode::SeekSet);   
     file_black.read((uint8_t*) &bmpFileHeader_black, sizeof(bmpFileHeader_black));
     file_black.read((uint8_t*) &bmpInfoHeader_black, sizeof(bmpInfoHeader_black));
+    _metrics.add(DisplayMetrics::FILE_READ, start);
 
     // check that both bitmaps are equal in format and are matching the panel
-    if ((bmpInfoHeader_black.biImageSize == bmpInfoHeader_red.biImageSize) && 
-        (bmpInfoHeader_red.biHeight == params->display->height()) && 
-        (bmpInfoHeader_red.biWidth == params->display->width())) {
-        // read the bitmap part from file
-        file_black.seek(bmpFileHeader_black.bOffset, fs::SeekMode::SeekSet);   
-        file_black.read(buf_file, bmpInfoHeader_black.biImageSize);
+    if ((bmpInfoHeader_black.biImageSize != bmpInfoHeader_red.biImageSize) || 
+        (bmpInfoHeader_black.biBitCount != 1) ||
+        (bmpInfoHeader_red.biBitCount != 1) ||
+        (bmpInfoHeader_red.biHeight != HEIGHT) || 
+        (bmpInfoHeader_red.biWidth != WIDTH)) {
+        LOGE(TAG, "%s is not matching the panel!", baseName);
+        file_red.close();
         file_black.close();
+        return false;
+    }
 
-        // malloc a buffer for the red pixel data
-        // ...and copy the raw pixel data
-        auto bitmap_size = (bmpInfoHeader_black.biWidth * bmpInfoHeader_black.biHeight * bmpInfoHeader_black.biBitCount) / 8;
-        auto row_width_pixel = (bmpInfoHeader_black.biWidth * bmpInfoHeader_black.biBitCount) / 8;
-        auto row_width_bmp = (bmpInfoHeader_black.biWidth * bmpInfoHeader_black.biBitCount) / 8;
-        row_width_bmp += (row_width_bmp % 4) == 0 ? 0 : 4 - (row_width_bmp % 4);
-        uint8_t* bitmap_black = (uint8_t*) ps_malloc(bitmap_size);
-        // copy pixels to match _display.setRotation(2);
-        for (int32_t row = 0; row < bmpInfoHeader_black.biHeight; row++) {
-            reverse_pxcpy(bitmap_black + row * row_width_pixel,
-                buf_file + (bmpInfoHeader_black.biHeight - row) * row_width_bmp, 
-                row_width_pixel);
+    // stream both bitmaps, band by band
+    bool complete = true;
+    file_red.seek(bmpFileHeader_red.bOffset, fs::SeekMode::SeekSet);   
+    file_black.seek(bmpFileHeader_black.bOffset, fs::SeekMode::SeekSet);   
+    for (int32_t y = 0; y < bmpInfoHeader_red.biHeight; y += CONFIG_DISPLAY_BAND_ROWS) {
+        int32_t rows = std::min<int32_t>(CONFIG_DISPLAY_BAND_ROWS, bmpInfoHeader_red.biHeight - y);
+        size_t raw_size = rows * BMP_ROW_BYTES;
+        start = esp_timer_get_time();
+        complete = file_red.read(_bandRaw, raw_size) == raw_size;
+        _metrics.add(DisplayMetrics::FILE_READ, start);
+        if (!complete) break;
+        start = esp_timer_get_time();
+        Soylent::PixelTransform::transformRows<ROW_BYTES, BMP_ROW_BYTES>(_bandRed, _bandRaw, 
+            rows, Soylent::PixelTransform::MIRROR_X);
+        _metrics.add(DisplayMetrics::DECODE, start);
+        start = esp_timer_get_time();
+        complete = file_black.read(_bandRaw, raw_size) == raw_size;
+        _metrics.add(DisplayMetrics::FILE_READ, start);
+        if (!complete) break;
+        start = esp_timer_get_time();
+        Soylent::PixelTransform::transformRows<ROW_BYTES, BMP_ROW_BYTES>(_bandBlack, _bandRaw, 
+            rows, Soylent::PixelTransform::MIRROR_X);
+        if (frame != nullptr) {
+            memcpy(frame + y * ROW_BYTES, _bandBlack, rows * ROW_BYTES);
+            memcpy(frame + PLANE_BYTES + y * ROW_BYTES, _bandRed, rows * ROW_BYTES);
         }
+        _metrics.add(DisplayMetrics::DECODE, start);
+        if (toPanel) {
+            _pushBand(y, rows, _bandBlack, _bandRed);
+        }
+    }
+    file_red.close();
+    file_black.close();
+
+    // the image is only usable, when the bitmaps were read completely
+    if (!complete) {
+        LOGE(TAG, "%s is corrupted!", baseName);
+        return false;
+    }
+
+    return true;
+}
+
+// Show an image from LittleFS (in worker)
+// nextImageName (if any) is read into the spare frame while the panel is refreshing
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_showImage(const char* imageName, const char* nextImageName) {
+    // recently shown images are served from the frame cache, without any flash I/O
+    const uint8_t* cached_frame = _frameCache.get(imageName);
+    if (cached_frame != nullptr) {
+        LOGD(TAG, "Cache hit for %s", imageName);
+    } else if (_prefetchValid && strcmp(_prefetchName, imageName) == 0) {
+        // the image was read while the previous one was refreshing, keep it for the cache as well
+        LOGD(TAG, "Prefetched %s", imageName);
+        uint8_t* frame = _frameCache.insert(imageName, FRAME_BYTES);
+        if (frame != nullptr) {
+            memcpy(frame, _prefetchFrame, FRAME_BYTES);
+            _frameCache.commit(imageName);
+        }
+        cached_frame = _prefetchFrame;
+    }
+    _prefetchValid = false;
+    if (cached_frame != nullptr) {
+        _pushFrame(cached_frame);
+        _refreshPanel(nextImageName);
+        _powerOffPanel();
+        return;
+    }
+
+    // get the base name of the image to show
+    char base_name[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];
+    if (!_getBaseName(imageName, base_name)) {
+        LOGE(TAG, "Invalid image name %s", imageName);
+        return;
+    }
 
-        // free the buffer
-        free(buf_file);
-
-        // draw the bitmaps
-        // writeImage set to match _display.setRotation(2);
-        params->display->writeScreenBuffer();
-        params->display->writeImage(bitmap_black, 
-                                    bitmap_red, 0, 0, 
-                                    params->display->width(), 
-                                    params->display->height(),
-                                    false, true, false);
-        params->display->refresh();
-        params->display->powerOff();
-
-        // free the bitmap buffers
-        free(bitmap_red);
-        free(bitmap_black);
+    // prefer the panel-native image, fall back to a pair of bitmaps
+    // ...while streaming, the frame is filled for the cache (if it fits into the budget)
+    uint8_t* frame = _frameCache.insert(imageName, 2 * PLANE_BYTES);
+    if (_writePanelImage(base_name, frame) || _writeBitmapImage(base_name, frame)) {
+        _shadowValid = _shadowFrame != nullptr;
+        _frameCache.commit(imageName);
+        _refreshPanel(nextImageName);
+        _powerOffPanel();
     } else {
-        // Do cleanup in case of image mismatch
+        _frameCache.remove(imageName);
+        LOGE(TAG, "No usable image for %s", imageName);
+    }
+}
 
-        file_black.close();
-        free(buf_file);
-        free(bitmap_red);
-    }    
+// Compose an image (or a blank frame) and its layers off-screen (in worker)
+// layers are drawn in order, the panel is written and refreshed only once for all of them
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_compose(const display_command& command) {
+    if (_composeFrame == nullptr)
+        return;
 
-    #ifdef LED_BUILTIN
-        digitalWrite(LED_BUILTIN, LOW);
-    #endif
+    // the background is taken from the frame cache or the spare frame, when possible
+    int64_t start = esp_timer_get_time();
+    if (command.image_name[0] == '\0') {
+        memset(_composeFrame, 0xFF, FRAME_BYTES);
+    } else {
+        const uint8_t* cached_frame = _frameCache.get(command.image_name);
+        if (cached_frame == nullptr && _prefetchValid && strcmp(_prefetchName, command.image_name) == 0) {
+            cached_frame = _prefetchFrame;
+        }
+        if (cached_frame != nullptr) {
+            memcpy(_composeFrame, cached_frame, FRAME_BYTES);
+        } else {
+            char base_name[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];
+            if (!_getBaseName(command.image_name, base_name) ||
+                !(_writePanelImage(base_name, _composeFrame, false) || _writeBitmapImage(base_name, _composeFrame, false))) {
+                LOGE(TAG, "No usable image for %s", command.image_name);
+                return;
+            }
+            uint8_t* frame = _frameCache.insert(command.image_name, FRAME_BYTES);
+            if (frame != nullptr) {
+                memcpy(frame, _composeFrame, FRAME_BYTES);
+                _frameCache.commit(command.image_name);
+            }
+        }
+    }
+    _metrics.add(DisplayMetrics::DECODE, start);
+
+    // draw the layers over the background
+    FrameCanvas canvas(_composeFrame, WIDTH, HEIGHT);
+    canvas.setRotation(_display.getRotation());
+    for (uint8_t i = 0; i < command.layer_count; i++) {
+        const command_layer& layer = command.layers[i];
+        const text_style& style = layer.style;
+        const char* content = command.text + layer.content_offset;
+        start = esp_timer_get_time();
+        switch (layer.type) {
+            case LayerType::TEXT: {
+                const auto& layout = _textLayout.layout(content, style.font_id, style.scale, style.box_w, style.box_h);
+                _textLayout.render(canvas, layout, style.box_x, style.box_y, style.align, style.valign, style.color);
+                break;
+            }
+            case LayerType::RECT:
+                canvas.fillRect(style.box_x, style.box_y, style.box_w, style.box_h, style.color);
+                break;
+            case LayerType::ICON:
+                // a missing icon leaves the rest of the composition intact
+                if (!_drawIcon(canvas, content, style.box_x, style.box_y)) {
+                    LOGW(TAG, "No usable icon for %s", content);
+                }
+                break;
+        }
+        _metrics.add(DisplayMetrics::DECODE, start);
+    }
+
+    // write what has changed and refresh, just once
+    _pushFrame(_composeFrame);
+    _refreshPanel();
+    _powerOffPanel();
+}
+
+// Draw an icon (a panel image of any size) with its top left corner at x, y (in worker)
+// the planes are rotated like the panel's RAM, so rows and pixels are read in reverse; white pixels are transparent
+// ...the icon is read twice: it's verified first, so a corrupted icon leaves the canvas untouched
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::_drawIcon(FrameCanvas& canvas, const char* baseName, int16_t x, int16_t y) {
+    for (bool draw : { false, true }) {
+        File file;
+        Soylent::EPDIMAGEHEADER epdHeader;
+        if (!_beginPanelImage(baseName, file, epdHeader))
+            return false;
+
+        // a row of the icon needs to fit into the band buffers
+        size_t row_bytes = (epdHeader.eWidth + 7) / 8;
+        if (row_bytes == 0 || row_bytes > ROW_BYTES || epdHeader.ePlaneSize != row_bytes * epdHeader.eHeight) {
+            LOGE(TAG, "%s is not an icon!", baseName);
+            file.close();
+            return false;
+        }
+
+        uint32_t crc_black = 0;
+        uint32_t crc_red = 0;
+        for (uint16_t row = 0; row < epdHeader.eHeight; row++) {
+            int64_t start = esp_timer_get_time();
+            bool complete = _decoderBlack.read(_bandBlack, row_bytes) == row_bytes;
+            complete = complete && _decoderRed.read(_bandRed, row_bytes) == row_bytes;
+            _metrics.add(DisplayMetrics::FILE_READ, start);
+            if (!complete) break;
+            if (!draw) {
+                crc_black = esp_rom_crc32_le(crc_black, _bandBlack, row_bytes);
+                crc_red = esp_rom_crc32_le(crc_red, _bandRed, row_bytes);
+                continue;
+            }
+            int16_t icon_y = y + epdHeader.eHeight - 1 - row;
+            for (uint16_t column = 0; column < epdHeader.eWidth; column++) {
+                uint8_t mask = 0x80 >> (column & 7);
+                int16_t icon_x = x + epdHeader.eWidth - 1 - column;
+                if ((_bandBlack[column / 8] & mask) == 0) {
+                    canvas.drawPixel(icon_x, icon_y, GxEPD_BLACK);
+                } else if ((_bandRed[column / 8] & mask) == 0) {
+                    canvas.drawPixel(icon_x, icon_y, GxEPD_RED);
+                }
+            }
+        }
+        file.close();
+
+        if (!draw && Soylent::Crc32::combine(crc_black, crc_red, epdHeader.ePlaneSize) != epdHeader.eChecksum) {
+            LOGE(TAG, "%s is corrupted!", baseName);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read the pending image into the spare frame (in worker, while the panel is busy)
+// only flash is read, the panel's RAM is left untouched
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_prefetchImage() {
+    char image_name[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];
+    strlcpy(image_name, _prefetchPending, sizeof(image_name));
+    _prefetchPending[0] = '\0';
+    char base_name[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];
+    if (_prefetchFrame == nullptr || 
+        _frameCache.get(image_name) != nullptr ||
+        !_getBaseName(image_name, base_name))
+        return;
+
+    _metrics.setPrefetching(true);
+    _prefetchValid = _writePanelImage(base_name, _prefetchFrame, false) || 
+                     _writeBitmapImage(base_name, _prefetchFrame, false);
+    _metrics.setPrefetching(false);
+    if (_prefetchValid) {
+        strlcpy(_prefetchName, image_name, sizeof(_prefetchName));
+        LOGD(TAG, "Prefetched %s while refreshing", _prefetchName);
+    }
+}
+
+// Get the base name of an image, e.g. "img_logo" for "/images/img_logo.svg"
+// it's the part between the last two of '/' and '.', baseName takes up to CONFIG_DISPLAY_IMAGE_NAME_LENGTH bytes
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::_getBaseName(const char* imageName, char* baseName) {
+    const char* end = strpbrk(imageName, "/.");
+    if (end == nullptr)
+        return false;
+    const char* start = imageName;
+    for (const char* next = strpbrk(end + 1, "/."); next != nullptr; next = strpbrk(end + 1, "/.")) {
+        start = end + 1;
+        end = next;
+    }
+    size_t length = end - start;
+    if (length >= CONFIG_DISPLAY_IMAGE_NAME_LENGTH)
+        return false;
+    memcpy(baseName, start, length);
+    baseName[length] = '\0';
+    return true;
+}
+
+// Get the file name of an image on LittleFS, fileName takes up to PATH_LENGTH bytes
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::_getFileName(char* fileName, const char* baseName, const char* extension) {
+    size_t length = snprintf(fileName, PATH_LENGTH, "/%s%s", baseName, extension);
+    return length < PATH_LENGTH;
+}
+
+// Refresh the panel (in worker)
+// the refresh is skipped, when the panel is showing the content of its RAM already (e.g. the same image again)
+// an image to prefetch is read while waiting for the panel
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_refreshPanel(const char* prefetchImageName) {
+    // without a shadow, the content of the panel's RAM isn't known
+    int64_t start = esp_timer_get_time();
+    uint32_t hash = _shadowValid ? esp_rom_crc32_le(0, _shadowFrame, FRAME_BYTES) : 0;
+    _metrics.add(DisplayMetrics::DECODE, start);
+    if (_shadowValid && _glassValid && hash == _glassHash) {
+        LOGD(TAG, "Panel is showing this frame already");
+        return;
+    }
+
+    // the content of the panel is unknown, until the refresh is done
+    _glassValid = false;
+    start = esp_timer_get_time();
+    if (prefetchImageName != nullptr) {
+        strlcpy(_prefetchPending, prefetchImageName, sizeof(_prefetchPending));
+    }
+    _refreshing = true;
+    _display.refresh();
+    _refreshing = false;
+    _prefetchPending[0] = '\0';
+    _metrics.add(DisplayMetrics::REFRESH, start);
+    _storeGlassHash(_shadowValid, hash);
+}
+
+// Power off the panel (in worker)
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_powerOffPanel() {
+    int64_t start = esp_timer_get_time();
+    _display.powerOff();
+    _metrics.add(DisplayMetrics::POWER_OFF, start);
+}
+
+// State of the panel right now
+template <class Panel>
+typename Soylent::DisplayClass<Panel>::state_snapshot Soylent::DisplayClass<Panel>::_getStateSnapshot() {
+    state_snapshot snapshot;
+    if (isBusy()) {
+        snapshot.state = "in_progress";
+    } else if (!isInitialized()) {
+        snapshot.state = "not_initialized";
+    } else {
+        snapshot.state = "idle";
+    }
+    snapshot.img_idx = _imageIdx;
+    const char* job = _job;
+    snapshot.job = job != nullptr ? job : "";
+    snapshot.refreshing = _refreshing;
+    return snapshot;
+}
+
+// Render the state, when it changed since it was rendered last
+// it's rendered outside of the critical section, concurrent updates are only increasing the version twice
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_updateState() {
+    state_snapshot snapshot = _getStateSnapshot();
+    taskENTER_CRITICAL(&cs_spinlock);
+    bool changed = snapshot.state != _stateSnapshot.state || snapshot.img_idx != _stateSnapshot.img_idx ||
+                   snapshot.job != _stateSnapshot.job || snapshot.refreshing != _stateSnapshot.refreshing;
+    taskEXIT_CRITICAL(&cs_spinlock);
+    if (!changed)
+        return;
+
+    // the strings are known not to need escaping
+    char json[CONFIG_DISPLAY_STATE_LENGTH];
+    int length = snprintf(json, sizeof(json), "{\"state\":\"%s\",\"img_idx\":%" PRId32 ",\"job\":\"%s\",\"refreshing\":%s,\"panels\":%d}",
+        snapshot.state, snapshot.img_idx, snapshot.job, snapshot.refreshing ? "true" : "false", CONFIG_DISPLAY_COUNT);
+    if (length < 0 || static_cast<size_t>(length) >= sizeof(json)) {
+        LOGE(TAG, "State doesn't fit into %u bytes", sizeof(json));
+        return;
+    }
 
     taskENTER_CRITICAL(&cs_spinlock);
-    params->srBusy->signalComplete();
-    taskEXIT_CRITICAL(&cs_spinlock);    
+    _stateSnapshot = snapshot;
+    memcpy(_stateJson, json, length + 1);
+    _stateLength = length;
+    _stateVersion++;
+    taskEXIT_CRITICAL(&cs_spinlock);
+}
 
-    vTaskDelete(NULL);
+// Read the hash of the frame shown by the panel, as stored before the restart
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::_loadGlassHash() {
+    Preferences preferences;
+    preferences.begin("display", true);
+    _storedValid = preferences.isKey(_glassKey);
+    _storedHash = preferences.getULong(_glassKey, 0);
+    preferences.end();
+    _glassHash = _storedHash;
+    _glassValid = _storedValid;
+    return _storedValid;
 }
 
-void Soylent::DisplayClass::_showImageCallback() {
-    _srBusy.setWaiting();
+// Keep the hash of the frame shown by the panel in NVS, once its refresh is done
+// NVS is written once per refresh at most (and not at all for an unchanged hash) to spare the flash,
+// ...the flip side is a refresh interrupted by a restart, after which the previous frame is (wrongly) trusted
+template <class Panel>
+void Soylent::DisplayClass<Panel>::_storeGlassHash(bool valid, uint32_t hash) {
+    _glassHash = hash;
+    _glassValid = valid;
+    if (valid == _storedValid && (!valid || hash == _storedHash))
+        return;
 
-    xTaskCreate(_async_showImageTask, "showImageTask", CONFIG_ASYNC_DISPLAY_STACK_SIZE, 
-                (void*) &_async_params,
-                tskIDLE_PRIORITY + 1, NULL);
-    
-    #ifdef DEBUG_ASYNC_TASK
-        // Just for debugging...
-        Task* report_async_showImageTask = new Task(TASK_IMMEDIATE, TASK_ONCE, 
-            [&] { 
-                LOGD(TAG, "...async imaging done!"); 
-                LOGD(TAG, "%s", _image_name.c_str()); 
-            }, _scheduler, false, NULL, NULL, true);   
-        report_async_showImageTask->enable();
-        report_async_showImageTask->waitFor(&_srBusy);
-    #endif
+    Preferences preferences;
+    if (!preferences.begin("display", false)) {
+        LOGE(TAG, "Can't open preferences");
+        return;
+    }
+    _storedHash = hash;
+    _storedValid = valid;
+    if (valid) {
+        preferences.putULong(_glassKey, hash);
+    } else if (preferences.isKey(_glassKey)) {
+        preferences.remove(_glassKey);
+    }
+    preferences.end();
+}
+
+template <class Panel>
+const char* Soylent::DisplayClass<Panel>::_getCommandName(CommandType type) {
+    switch (type) {
+        case CommandType::WIPE:
+            return "wipe";
+        case CommandType::PRINT_TAG:
+            return "print_tag";
+        case CommandType::PRINT_TEXT:
+            return "print_text";
+        case CommandType::SHOW_IMAGE:
+            return "show_image";
+        case CommandType::COMPOSE:
+            return "compose";
+    }
+    return "unknown";
+}
+
+// Timing of the recently processed commands
+template <class Panel>
+Soylent::DisplayMetrics& Soylent::DisplayClass<Panel>::getMetrics() {
+    return _metrics;
+}
+
+// Frame shown by the panel (the shadow of its RAM) and its hash, which is read in place
+// returns nullptr while the content is unknown or changing
+template <class Panel>
+const uint8_t* Soylent::DisplayClass<Panel>::getFrame(uint32_t& hash) {
+    if (_srInitialized.pending() || isBusy() || !_shadowValid || !_glassValid)
+        return nullptr;
+
+    // the panel's RAM may have been written without a refresh (e.g. an image was incomplete)
+    hash = esp_rom_crc32_le(0, _shadowFrame, FRAME_BYTES);
+    return hash == _glassHash ? _shadowFrame : nullptr;
+}
+
+// Drop all cached frames, e.g. when the content of the filesystem has changed
+// the cache is cleared by the worker before processing the next command
+template <class Panel>
+void Soylent::DisplayClass<Panel>::invalidateImageCache() {
+    _frameCacheInvalid = true;
+}
+
+// Set the byte budget of the frame cache (applied by the worker)
+template <class Panel>
+void Soylent::DisplayClass<Panel>::setImageCacheBudget(size_t budget) {
+    _frameCacheBudget = budget;
+}
+
+// Set the SPI clock of the panel (applied by the worker)
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::setSpiClock(uint32_t clock) {
+    if (clock == 0 || clock > panel_traits<Panel>::spi_clock_max) {
+        LOGW(TAG, "SPI clock out of range: %" PRIu32 " Hz", clock);
+        return false;
+    }
+    _spiClock = clock;
+    return true;
+}
+
+template <class Panel>
+uint32_t Soylent::DisplayClass<Panel>::getSpiClock() {
+    return _spiClock;
 }
 
-void Soylent::DisplayClass::showImage(const char* imageName) {
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::showImage(const char* imageName, const char* nextImageName) {
     if (_srInitialized.pending()) {
         LOGW(TAG, "uninitialized, can't do it!");
-        return;
+        return false;
     }
 
-    // Store image name in the async_params struct
-    _image_name.assign(imageName); 
-    _async_params.image_name = &_image_name;
-    LOGD(TAG, "got %s", _image_name.c_str());
+    // copy the image name into the command, so it can't be changed while being processed
+    display_command command = {};
+    command.type = CommandType::SHOW_IMAGE;
+    if (strlcpy(command.image_name, imageName, sizeof(command.image_name)) >= sizeof(command.image_name)) {
+        LOGW(TAG, "Image name too long: %s", imageName);
+        return false;
+    }
+    if (nextImageName != nullptr && 
+        strlcpy(command.next_image_name, nextImageName, sizeof(command.next_image_name)) >= sizeof(command.next_image_name)) {
+        LOGW(TAG, "Image name too long: %s", nextImageName);
+        return false;
+    }
 
-    // create and run a task for creating and running an async task for imaging on the display...
-    // task is pending until the display is not busy
-    LOGD(TAG, "Start imaging: %s", _image_name.c_str());
-    Task* showImageTask = new Task(TASK_IMMEDIATE, TASK_ONCE, [&] { _showImageCallback(); }, 
-        _scheduler, false, NULL, NULL, true);   
-    showImageTask->enable();
-    showImageTask->waitFor(&_srBusy);
+    LOGD(TAG, "Start imaging: %s", command.image_name);
+    return _enqueue(command);
+}
+
+// Show an image (or a blank frame, for an empty name) with layers drawn over it, in a single refresh
+// the contents of all layers are copied into the command, so they can't be changed while being processed
+template <class Panel>
+bool Soylent::DisplayClass<Panel>::showComposition(const char* imageName, const display_layer* layers, size_t count) {
+    if (_srInitialized.pending()) {
+        LOGW(TAG, "uninitialized, can't do it!");
+        return false;
+    }
+    if (count > CONFIG_DISPLAY_LAYERS) {
+        LOGW(TAG, "Too many layers: %u", count);
+        return false;
+    }
+    if (_composeFrame == nullptr) {
+        LOGW(TAG, "No frame for composing!");
+        return false;
+    }
+
+    display_command command = {};
+    command.type = CommandType::COMPOSE;
+    if (imageName != nullptr &&
+        strlcpy(command.image_name, imageName, sizeof(command.image_name)) >= sizeof(command.image_name)) {
+        LOGW(TAG, "Image name too long: %s", imageName);
+        return false;
+    }
+
+    // the contents are stored one after another in the text of the command
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        const display_layer& layer = layers[i];
+        const text_style& style = layer.style;
+        const char* content = layer.content != nullptr ? layer.content : "";
+        bool valid = style.box_w > 0 && style.box_h > 0;
+        switch (layer.type) {
+            case LayerType::TEXT:
+                valid = valid && Soylent::TextLayout::getFont(style.font_id) != nullptr && style.scale > 0 &&
+                        (style.color == GxEPD_BLACK || style.color == GxEPD_RED);
+                break;
+            case LayerType::RECT:
+                valid = valid && (style.color == GxEPD_BLACK || style.color == GxEPD_RED || style.color == GxEPD_WHITE);
+                break;
+            case LayerType::ICON:
+                valid = content[0] != '\0' && strchr(content, '/') == nullptr;
+                break;
+            default:
+                valid = false;
+        }
+        if (!valid) {
+            LOGW(TAG, "Invalid layer %u", i);
+            return false;
+        }
+
+        size_t length = strlcpy(command.text + offset, content, sizeof(command.text) - offset);
+        if (offset + length >= sizeof(command.text)) {
+            LOGW(TAG, "Layers too long");
+            return false;
+        }
+        command.layers[i].type = layer.type;
+        command.layers[i].style = style;
+        command.layers[i].content_offset = offset;
+        offset += length + 1;
+    }
+    command.layer_count = count;
+
+    LOGD(TAG, "Start composing: %s with %u layers", command.image_name, count);
+    return _enqueue(command);
 }
+
+// the display of this firmware, further panels need to be instantiated here as well
+template class Soylent::DisplayClass<DISPLAY_PANEL>;
@@ -38,7 +38,10 @@ void Soylent::ESPRestartClass::_cleanupCallback() {
     WebSite.end();
     WebServer.end();
     ESPConnect.end();
-    Display.end();
+    Playlist.end();
+    for (auto display : Displays) {
+        display->end();
+    }
 
     // ...and finally, the Restart-Task can be enabled subsequently
     _restartTask->enableDelayed(_delayBeforeRestart);
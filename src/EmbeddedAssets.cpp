@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <ePaper.h>
+#include <EmbeddedAssets.h>
+#include <asset_table.h>
+
+// Find an embedded asset by the path it's served at, nullptr if there is none
+const Soylent::embedded_asset* Soylent::find_embedded_asset(const char* path) {
+    for (const auto& asset : EMBEDDED_ASSETS) {
+        if (strcmp(asset.path, path) == 0)
+            return &asset;
+    }
+    return nullptr;
+}
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <ePaper.h>
+#include <FileTags.h>
+#include <esp_rom_crc.h>
+#define TAG "FileTags"
+
+Soylent::FileTags::FileTags()
+    : _tags{}
+    , _uses(0)
+    , _buffer{} {
+}
+
+// Get the content hash of a file, it's read only when the hash isn't known yet
+// returns false when there is no such file
+bool Soylent::FileTags::get(const char* path, uint32_t& hash) {
+    file_tag* least_recently_used = &_tags[0];
+    for (auto& tag : _tags) {
+        if (tag.last_used != 0 && strcmp(tag.path, path) == 0) {
+            tag.last_used = ++_uses;
+            hash = tag.hash;
+            return true;
+        }
+        if (tag.last_used < least_recently_used->last_used)
+            least_recently_used = &tag;
+    }
+
+    if (!_hash(path, hash))
+        return false;
+
+    // long paths are hashed for every request
+    if (strlcpy(least_recently_used->path, path, sizeof(least_recently_used->path)) >= sizeof(least_recently_used->path)) {
+        least_recently_used->last_used = 0;
+        return true;
+    }
+    least_recently_used->hash = hash;
+    least_recently_used->last_used = ++_uses;
+    return true;
+}
+
+// Drop all hashes, e.g. when files were changed
+void Soylent::FileTags::clear() {
+    for (auto& tag : _tags)
+        tag.last_used = 0;
+}
+
+bool Soylent::FileTags::_hash(const char* path, uint32_t& hash) {
+    File file = LittleFS.open(path, "r");
+    if (!file || file.isDirectory())
+        return false;
+
+    int64_t start = esp_timer_get_time();
+    hash = 0;
+    size_t length;
+    while ((length = file.read(_buffer, sizeof(_buffer))) > 0) {
+        hash = esp_rom_crc32_le(hash, _buffer, length);
+    }
+    LOGD(TAG, "Hashed %s (%u bytes) in %lld us", path, file.size(), esp_timer_get_time() - start);
+    file.close();
+    return true;
+}
@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <ePaper.h>
+#include <FrameBitmap.h>
+
+// colors of the palette
+#define BITMAP_WHITE 0
+#define BITMAP_BLACK 1
+#define BITMAP_RED 2
+
+Soylent::FrameBitmap::FrameBitmap(const uint8_t* frame, uint16_t panelWidth, uint16_t panelHeight, uint8_t rotation)
+    : _frame(frame)
+    , _panelWidth(panelWidth)
+    , _panelHeight(panelHeight)
+    , _rotation(rotation & 3)
+    , _width(_rotation & 1 ? panelHeight : panelWidth)
+    , _height(_rotation & 1 ? panelWidth : panelHeight)
+    , _rowSize((_width * 4 + 31) / 32 * 4) {
+}
+
+size_t Soylent::FrameBitmap::getSize() const {
+    return HEADER_SIZE + _rowSize * _height;
+}
+
+// Generate length bytes of the bitmap from index on, returns the number of bytes written
+// rows are stored bottom-up
+size_t Soylent::FrameBitmap::read(uint8_t* dst, size_t length, size_t index) const {
+    size_t size = getSize();
+    if (index >= size)
+        return 0;
+    length = std::min(length, size - index);
+
+    size_t written = 0;
+    if (index < HEADER_SIZE) {
+        uint8_t header[HEADER_SIZE];
+        _writeHeader(header);
+        written = std::min(length, HEADER_SIZE - index);
+        memcpy(dst, header + index, written);
+    }
+    for (size_t offset = index + written - HEADER_SIZE; written < length; offset++, written++) {
+        uint16_t y = _height - 1 - offset / _rowSize;
+        uint16_t x = (offset % _rowSize) * 2;
+        uint8_t pixels = 0;
+        if (x < _width)
+            pixels |= _getPixel(x, y) << 4;
+        if (x + 1 < _width)
+            pixels |= _getPixel(x + 1, y);
+        dst[written] = pixels;
+    }
+    return written;
+}
+
+void Soylent::FrameBitmap::_writeHeader(uint8_t* header) const {
+    Soylent::BITMAPFILEHEADER bmpFileHeader = {};
+    bmpFileHeader.bType = 0x4D42;
+    bmpFileHeader.bSize = getSize();
+    bmpFileHeader.bOffset = HEADER_SIZE;
+
+    Soylent::BITMAPINFOHEADER bmpInfoHeader = {};
+    bmpInfoHeader.biInfoSize = sizeof(bmpInfoHeader);
+    bmpInfoHeader.biWidth = _width;
+    bmpInfoHeader.biHeight = _height;
+    bmpInfoHeader.biPlanes = 1;
+    bmpInfoHeader.biBitCount = 4;
+    bmpInfoHeader.biImageSize = _rowSize * _height;
+    bmpInfoHeader.biClrUsed = 3;
+    bmpInfoHeader.biClrImportant = 3;
+
+    // palette entries are blue, green, red, reserved
+    const uint8_t palette[3 * 4] = {
+        0xFF, 0xFF, 0xFF, 0x00,
+        0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0xFF, 0x00
+    };
+
+    memcpy(header, &bmpFileHeader, sizeof(bmpFileHeader));
+    memcpy(header + sizeof(bmpFileHeader), &bmpInfoHeader, sizeof(bmpInfoHeader));
+    memcpy(header + sizeof(bmpFileHeader) + sizeof(bmpInfoHeader), palette, sizeof(palette));
+}
+
+// Color of a pixel (after rotation), red is taking precedence (as on the panel)
+uint8_t Soylent::FrameBitmap::_getPixel(uint16_t x, uint16_t y) const {
+    // move the pixel around like FrameCanvas does
+    switch (_rotation) {
+        case 1:
+            std::swap(x, y);
+            x = _panelWidth - x - 1;
+            break;
+        case 2:
+            x = _panelWidth - x - 1;
+            y = _panelHeight - y - 1;
+            break;
+        case 3:
+            std::swap(x, y);
+            y = _panelHeight - y - 1;
+            break;
+    }
+
+    size_t plane_size = ((_panelWidth + 7) / 8) * _panelHeight;
+    size_t i = x / 8 + y * ((_panelWidth + 7) / 8);
+    uint8_t mask = 1 << (7 - x % 8);
+    if ((_frame[plane_size + i] & mask) == 0)
+        return BITMAP_RED;
+    if ((_frame[i] & mask) == 0)
+        return BITMAP_BLACK;
+    return BITMAP_WHITE;
+}
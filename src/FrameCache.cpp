@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+// only what's needed, so the cache can be tested on the host (see test/native/)
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <Logging.h>
+#include <FrameCache.h>
+#define TAG "FrameCache"
+
+Soylent::FrameCache::FrameCache()
+    : _entries{}
+    , _uses(0)
+    , _budget(0)
+    , _usage(0) {
+}
+
+Soylent::FrameCache::~FrameCache() {
+    for (auto& entry : _entries)
+        _free(&entry);
+}
+
+// Set the byte budget, frames are released when shrinking
+void Soylent::FrameCache::setBudget(size_t budget) {
+    _budget = budget;
+    _trim();
+    LOGD(TAG, "Budget: %u bytes (%s)", _budget, psramFound() ? "PSRAM" : "internal");
+}
+
+size_t Soylent::FrameCache::getBudget() {
+    return _budget;
+}
+
+size_t Soylent::FrameCache::getUsage() {
+    return _usage;
+}
+
+// Get a frame, returns nullptr on a miss
+const uint8_t* Soylent::FrameCache::get(const char* key) {
+    cache_entry* entry = _find(key);
+    if (entry == nullptr || !entry->valid)
+        return nullptr;
+
+    // mark as most recently used
+    entry->last_used = ++_uses;
+    return entry->frame;
+}
+
+// Get a frame for being filled by the caller
+// the frame is not served by get() until it is committed
+// ...a dropped frame of the same size is re-used, frames are only allocated while the budget isn't filled
+uint8_t* Soylent::FrameCache::insert(const char* key, size_t frameSize) {
+    remove(key);
+    if (frameSize > _budget || strlen(key) >= sizeof(cache_entry::key))
+        return nullptr;
+
+    cache_entry* entry = nullptr;
+    while ((entry = _findUnused(true, frameSize)) == nullptr) {
+        if (_usage + frameSize <= _budget && (entry = _findUnused(false)) != nullptr) {
+            // place frames in PSRAM when present
+            entry->frame = (uint8_t*) (psramFound() ?
+                heap_caps_malloc(frameSize, MALLOC_CAP_SPIRAM) :
+                heap_caps_malloc(frameSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+            if (entry->frame == nullptr) {
+                LOGW(TAG, "Out of memory for %s", key);
+                return nullptr;
+            }
+            entry->size = frameSize;
+            _usage += frameSize;
+            break;
+        }
+
+        // release unused frames of another size first, then drop the least recently used frame
+        cache_entry* unused = _findUnused(true);
+        if (unused != nullptr) {
+            _free(unused);
+            continue;
+        }
+        cache_entry* least_recently_used = _findLeastRecentlyUsed();
+        if (least_recently_used == nullptr)
+            return nullptr;
+        LOGD(TAG, "Evict %s", least_recently_used->key);
+        least_recently_used->last_used = 0;
+        least_recently_used->valid = false;
+    }
+
+    strlcpy(entry->key, key, sizeof(entry->key));
+    entry->last_used = ++_uses;
+    entry->valid = false;
+    return entry->frame;
+}
+
+void Soylent::FrameCache::commit(const char* key) {
+    cache_entry* entry = _find(key);
+    if (entry != nullptr)
+        entry->valid = true;
+}
+
+// Drop a frame, it's kept for re-use
+void Soylent::FrameCache::remove(const char* key) {
+    cache_entry* entry = _find(key);
+    if (entry != nullptr) {
+        entry->last_used = 0;
+        entry->valid = false;
+    }
+}
+
+// Drop all frames, they are kept for re-use
+void Soylent::FrameCache::clear() {
+    for (auto& entry : _entries) {
+        entry.last_used = 0;
+        entry.valid = false;
+    }
+}
+
+Soylent::FrameCache::cache_entry* Soylent::FrameCache::_find(const char* key) {
+    for (auto& entry : _entries) {
+        if (entry.last_used != 0 && strcmp(entry.key, key) == 0)
+            return &entry;
+    }
+    return nullptr;
+}
+
+// Find an unused entry with a frame (of the size, if given) or without a frame
+Soylent::FrameCache::cache_entry* Soylent::FrameCache::_findUnused(bool allocated, size_t size) {
+    for (auto& entry : _entries) {
+        if (entry.last_used == 0 && (entry.frame != nullptr) == allocated && (size == 0 || entry.size == size))
+            return &entry;
+    }
+    return nullptr;
+}
+
+Soylent::FrameCache::cache_entry* Soylent::FrameCache::_findLeastRecentlyUsed() {
+    cache_entry* least_recently_used = nullptr;
+    for (auto& entry : _entries) {
+        if (entry.last_used != 0 && (least_recently_used == nullptr || entry.last_used < least_recently_used->last_used))
+            least_recently_used = &entry;
+    }
+    return least_recently_used;
+}
+
+void Soylent::FrameCache::_free(cache_entry* entry) {
+    if (entry->frame != nullptr) {
+        heap_caps_free(entry->frame);
+        _usage -= entry->size;
+    }
+    entry->frame = nullptr;
+    entry->size = 0;
+    entry->last_used = 0;
+    entry->valid = false;
+}
+
+// Release frames until the allocated bytes fit into the budget, unused frames first
+void Soylent::FrameCache::_trim() {
+    while (_usage > _budget) {
+        cache_entry* entry = _findUnused(true);
+        if (entry == nullptr)
+            entry = _findLeastRecentlyUsed();
+        if (entry == nullptr)
+            break;
+        LOGD(TAG, "Release %s", entry->key);
+        _free(entry);
+    }
+}
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <FrameCanvas.h>
+#include <algorithm>
+
+Soylent::FrameCanvas::FrameCanvas(uint8_t* frame, int16_t w, int16_t h)
+    : Adafruit_GFX(w, h)
+    , _frame(frame)
+    , _planeSize(((w + 7) / 8) * h) {
+}
+
+void Soylent::FrameCanvas::drawPixel(int16_t x, int16_t y, uint16_t color) {
+    if ((x < 0) || (x >= width()) || (y < 0) || (y >= height())) return;
+
+    // check rotation, move pixel around if necessary
+    switch (getRotation()) {
+        case 1:
+            std::swap(x, y);
+            x = WIDTH - x - 1;
+            break;
+        case 2:
+            x = WIDTH - x - 1;
+            y = HEIGHT - y - 1;
+            break;
+        case 3:
+            std::swap(x, y);
+            y = HEIGHT - y - 1;
+            break;
+    }
+
+    // set the pixel to white in both planes, then add the ink
+    size_t i = x / 8 + y * ((WIDTH + 7) / 8);
+    uint8_t mask = 1 << (7 - x % 8);
+    uint8_t* black = _frame + i;
+    uint8_t* red = _frame + _planeSize + i;
+    *black |= mask;
+    *red |= mask;
+    if (color == GxEPD_BLACK) {
+        *black &= ~mask;
+    } else if (color == GxEPD_RED) {
+        *red &= ~mask;
+    }
+}
+
+void Soylent::FrameCanvas::fillScreen(uint16_t color) {
+    memset(_frame, color == GxEPD_BLACK ? 0x00 : 0xFF, _planeSize);
+    memset(_frame + _planeSize, color == GxEPD_RED ? 0x00 : 0xFF, _planeSize);
+}
+
+uint8_t* Soylent::FrameCanvas::getFrame() {
+    return _frame;
+}
+
+size_t Soylent::FrameCanvas::getPlaneSize() {
+    return _planeSize;
+}
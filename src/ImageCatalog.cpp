@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <ePaper.h>
+#include <ImageCatalog.h>
+#define TAG "ImageCatalog"
+
+Soylent::ImageCatalog::ImageCatalog()
+    : _entries{}
+    , _count(0) {
+}
+
+// Parse the catalog straight from the file, only name and src of the images are kept
+bool Soylent::ImageCatalog::load(const char* path) {
+    _count = 0;
+    File file = LittleFS.open(path, "r");
+    if (!file || file.isDirectory()) {
+        LOGE(TAG, "Can't open %s", path);
+        return false;
+    }
+
+    JsonDocument filter;
+    filter["images"][0]["name"] = true;
+    filter["images"][0]["src"] = true;
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, file, DeserializationOption::Filter(filter));
+    file.close();
+    if (error || !doc["images"].is<JsonArray>()) {
+        LOGE(TAG, "Can't parse %s (%s)", path, error.c_str());
+        return false;
+    }
+
+    for (JsonObject image : doc["images"].as<JsonArray>()) {
+        if (_count == CONFIG_WEBSITE_CATALOG_SIZE) {
+            LOGW(TAG, "Catalog is full, further images are ignored");
+            break;
+        }
+        catalog_entry& entry = _entries[_count++];
+        strlcpy(entry.name, image["name"] | "", sizeof(entry.name));
+        strlcpy(entry.src, image["src"] | "", sizeof(entry.src));
+    }
+    return true;
+}
+
+// Add an image (or rename an existing one with the same src)
+// the catalog is written to a temporary file and moved into place, the entries are only changed when it was written
+bool Soylent::ImageCatalog::update(const char* path, const char* name, const char* src) {
+    int32_t index = _find(src);
+    if (index < 0 && _count == CONFIG_WEBSITE_CATALOG_SIZE) {
+        LOGW(TAG, "Catalog is full");
+        return false;
+    }
+    catalog_entry changed;
+    strlcpy(changed.name, name, sizeof(changed.name));
+    if (strlcpy(changed.src, src, sizeof(changed.src)) >= sizeof(changed.src)) {
+        LOGW(TAG, "Image name too long: %s", src);
+        return false;
+    }
+    if (index < 0)
+        index = _count;
+
+    size_t count = static_cast<size_t>(index) == _count ? _count + 1 : _count;
+    JsonDocument doc;
+    JsonArray images = doc["images"].to<JsonArray>();
+    for (size_t i = 0; i < count; i++) {
+        const catalog_entry& entry = i == static_cast<size_t>(index) ? changed : _entries[i];
+        JsonObject image = images.add<JsonObject>();
+        image["name"] = entry.name;
+        image["src"] = entry.src;
+        image["img_idx"] = i + 1;
+    }
+
+    std::string temp_path = std::string(path) + ".tmp";
+    File file = LittleFS.open(temp_path.c_str(), "w");
+    bool written = file && serializeJson(doc, file) > 0;
+    file.close();
+    if (!written || !Soylent::replace_file(temp_path.c_str(), path)) {
+        LOGE(TAG, "Can't write %s", path);
+        LittleFS.remove(temp_path.c_str());
+        return false;
+    }
+
+    _entries[index] = changed;
+    _count = count;
+    return true;
+}
+
+// Entry of an image by its img_idx (starting at 1), nullptr if there is none
+const Soylent::ImageCatalog::catalog_entry* Soylent::ImageCatalog::get(int32_t imgIdx) const {
+    return imgIdx >= 1 && static_cast<size_t>(imgIdx) <= _count ? &_entries[imgIdx - 1] : nullptr;
+}
+
+size_t Soylent::ImageCatalog::size() const {
+    return _count;
+}
+
+// Index of the entry with the given src, -1 if there is none
+int32_t Soylent::ImageCatalog::_find(const char* src) const {
+    for (size_t i = 0; i < _count; i++) {
+        if (strcmp(_entries[i].src, src) == 0)
+            return i;
+    }
+    return -1;
+}
@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <ePaper.h>
+#include <esp_rom_crc.h>
+#include <ImageDitherer.h>
+#define TAG "ImageDitherer"
+
+static const char* OUT_OF_MEMORY = "out of memory";
+
+Soylent::ImageDitherer::ImageDitherer(uint16_t panelWidth, uint16_t panelHeight)
+    : _panelWidth(panelWidth)
+    , _panelHeight(panelHeight)
+    , _rowBytes(panelWidth / 8)
+    , _frame(nullptr)
+    , _errors(nullptr)
+    , _errorsCurrent(nullptr)
+    , _errorsNext(nullptr)
+    , _format(Format::BMP)
+    , _state(State::FAILED)
+    , _error("not started")
+    , _headerFill(0)
+    , _skip(0)
+    , _width(0)
+    , _height(0)
+    , _bottomUp(false)
+    , _bytesPerPixel(3)
+    , _rowPadding(0)
+    , _offsetX(0)
+    , _offsetY(0)
+    , _column(0)
+    , _row(0)
+    , _pixelFill(0)
+    , _paddingLeft(0) {
+}
+
+Soylent::ImageDitherer::~ImageDitherer() {
+    free(_frame);
+    free(_errors);
+}
+
+// Prepare for an image, the size is only needed for raw RGB (bitmaps have a header)
+bool Soylent::ImageDitherer::begin(Format format, uint16_t width, uint16_t height) {
+    // planes in PSRAM when present (in internal RAM otherwise), the error rows are small
+    if (_frame == nullptr)
+        _frame = (uint8_t*) Soylent::malloc_prefer_psram(2 * getPlaneSize());
+    if (_errors == nullptr)
+        _errors = (int16_t*) malloc(2 * 3 * (_panelWidth + 2) * sizeof(int16_t));
+    if (_frame == nullptr || _errors == nullptr) {
+        _fail(OUT_OF_MEMORY);
+        return false;
+    }
+
+    // start with a white image and no errors to diffuse
+    memset(_frame, 0xFF, 2 * getPlaneSize());
+    memset(_errors, 0, 2 * 3 * (_panelWidth + 2) * sizeof(int16_t));
+    _errorsCurrent = _errors;
+    _errorsNext = _errors + 3 * (_panelWidth + 2);
+    _format = format;
+    _error = nullptr;
+    _headerFill = 0;
+    _skip = 0;
+
+    if (_format == Format::BMP) {
+        _state = State::HEADER;
+        return true;
+    }
+
+    if (width == 0 || height == 0) {
+        _fail("invalid size");
+        return false;
+    }
+    _startPixels(width, height, false, 3, 0);
+    return true;
+}
+
+// Consume a chunk of the image
+bool Soylent::ImageDitherer::write(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        switch (_state) {
+            case State::HEADER: {
+                size_t part = std::min(length, sizeof(_header) - _headerFill);
+                memcpy(_header + _headerFill, data, part);
+                _headerFill += part;
+                data += part;
+                length -= part;
+                if (_headerFill == sizeof(_header) && !_parseHeader())
+                    return false;
+                break;
+            }
+            case State::SKIP: {
+                size_t part = std::min<size_t>(length, _skip);
+                _skip -= part;
+                data += part;
+                length -= part;
+                if (_skip == 0)
+                    _state = State::PIXELS;
+                break;
+            }
+            case State::PIXELS:
+                // padding at the end of a bitmap row
+                if (_paddingLeft > 0) {
+                    _paddingLeft--;
+                    data++;
+                    length--;
+                    break;
+                }
+                _pixelBytes[_pixelFill++] = *data++;
+                length--;
+                if (_pixelFill < _bytesPerPixel)
+                    break;
+                _pixelFill = 0;
+                if (_format == Format::BMP) {
+                    _pixel(_pixelBytes[2], _pixelBytes[1], _pixelBytes[0]);
+                } else {
+                    _pixel(_pixelBytes[0], _pixelBytes[1], _pixelBytes[2]);
+                }
+                if (++_column == _width) {
+                    _column = 0;
+                    _paddingLeft = _rowPadding;
+                    _nextRow();
+                }
+                break;
+            case State::DONE:
+                // ignore trailing data
+                return true;
+            default:
+                return false;
+        }
+    }
+    return _state != State::FAILED;
+}
+
+bool Soylent::ImageDitherer::isComplete() {
+    return _state == State::DONE;
+}
+
+const char* Soylent::ImageDitherer::getError() {
+    if (_state == State::DONE)
+        return nullptr;
+    return _error != nullptr ? _error : "incomplete image";
+}
+
+// The image was rejected, because there wasn't enough memory for the planes
+bool Soylent::ImageDitherer::isOutOfMemory() {
+    return _state == State::FAILED && _error == OUT_OF_MEMORY;
+}
+
+const uint8_t* Soylent::ImageDitherer::getFrame() {
+    return _frame;
+}
+
+size_t Soylent::ImageDitherer::getPlaneSize() {
+    return _rowBytes * _panelHeight;
+}
+
+// Write the planes into a panel-native image (see tools/svg2rbmono.py)
+// the image is written to a temporary file first and renamed when complete
+bool Soylent::ImageDitherer::save(const char* fileName) {
+    if (_state != State::DONE)
+        return false;
+
+    Soylent::EPDIMAGEHEADER epdHeader = {};
+    epdHeader.eMagic = EPD_IMAGE_MAGIC;
+    epdHeader.eVersion = EPD_IMAGE_VERSION;
+    epdHeader.eRotation = EPD_IMAGE_ROTATION;
+    epdHeader.eWidth = _panelWidth;
+    epdHeader.eHeight = _panelHeight;
+    epdHeader.ePlaneSize = getPlaneSize();
+    epdHeader.eChecksum = esp_rom_crc32_le(0, _frame, 2 * getPlaneSize());
+
+    std::string temp_name = std::string(fileName) + ".tmp";
+    File file = LittleFS.open(temp_name.c_str(), "w");
+    if (!file) {
+        LOGE(TAG, "Can't create %s", temp_name.c_str());
+        return false;
+    }
+    bool written = file.write((const uint8_t*) &epdHeader, sizeof(epdHeader)) == sizeof(epdHeader) &&
+                   file.write(_frame, 2 * getPlaneSize()) == 2 * getPlaneSize();
+    file.close();
+    if (!written) {
+        LOGE(TAG, "Can't write %s", temp_name.c_str());
+        LittleFS.remove(temp_name.c_str());
+        return false;
+    }
+
+    // replace an existing image
+    if (!Soylent::replace_file(temp_name.c_str(), fileName)) {
+        LOGE(TAG, "Can't rename %s", temp_name.c_str());
+        LittleFS.remove(temp_name.c_str());
+        return false;
+    }
+
+    LOGD(TAG, "Saved %s", fileName);
+    return true;
+}
+
+// Check the bitmap's header, only uncompressed 24 or 32 bit bitmaps are supported
+bool Soylent::ImageDitherer::_parseHeader() {
+    Soylent::BITMAPFILEHEADER bmpFileHeader;
+    Soylent::BITMAPINFOHEADER bmpInfoHeader;
+    memcpy(&bmpFileHeader, _header, sizeof(bmpFileHeader));
+    memcpy(&bmpInfoHeader, _header + sizeof(bmpFileHeader), sizeof(bmpInfoHeader));
+
+    if (bmpFileHeader.bType != 0x4D42 ||
+        bmpFileHeader.bOffset < sizeof(_header) ||
+        bmpInfoHeader.biPlanes != 1 ||
+        bmpInfoHeader.biWidth <= 0 ||
+        bmpInfoHeader.biHeight == 0) {
+        _fail("not a bitmap");
+        return false;
+    }
+    if (!(bmpInfoHeader.biBitCount == 24 && bmpInfoHeader.biCompression == 0) &&
+        !(bmpInfoHeader.biBitCount == 32 && (bmpInfoHeader.biCompression == 0 || bmpInfoHeader.biCompression == 3))) {
+        _fail("only uncompressed 24 or 32 bit bitmaps are supported");
+        return false;
+    }
+
+    // rows are aligned by 4 bytes
+    uint8_t bytes_per_pixel = bmpInfoHeader.biBitCount / 8;
+    uint32_t row_size = (bmpInfoHeader.biWidth * bytes_per_pixel + 3) & ~3u;
+    _startPixels(bmpInfoHeader.biWidth, std::abs(bmpInfoHeader.biHeight), bmpInfoHeader.biHeight > 0,
+                 bytes_per_pixel, row_size - bmpInfoHeader.biWidth * bytes_per_pixel);
+    _skip = bmpFileHeader.bOffset - sizeof(_header);
+    if (_skip > 0)
+        _state = State::SKIP;
+    return true;
+}
+
+void Soylent::ImageDitherer::_startPixels(int32_t width, int32_t height, bool bottomUp, uint8_t bytesPerPixel, uint8_t rowPadding) {
+    _width = width;
+    _height = height;
+    _bottomUp = bottomUp;
+    _bytesPerPixel = bytesPerPixel;
+    _rowPadding = rowPadding;
+    _offsetX = (static_cast<int32_t>(_panelWidth) - width) / 2;
+    _offsetY = (static_cast<int32_t>(_panelHeight) - height) / 2;
+    _column = 0;
+    _row = 0;
+    _pixelFill = 0;
+    _paddingLeft = 0;
+    _state = State::PIXELS;
+    LOGD(TAG, "Dithering %dx%d pixels", width, height);
+}
+
+void Soylent::ImageDitherer::_fail(const char* error) {
+    LOGW(TAG, "Failed: %s", error);
+    _error = error;
+    _state = State::FAILED;
+}
+
+// Dither a pixel to black, red or white and diffuse the error (Floyd-Steinberg)
+// right: 7/16, below left: 3/16, below: 5/16, below right: 1/16
+void Soylent::ImageDitherer::_pixel(int16_t r, int16_t g, int16_t b) {
+    int32_t x = _column + _offsetX;
+    int32_t y = (_bottomUp ? _height - 1 - _row : _row) + _offsetY;
+    if (x < 0 || x >= _panelWidth || y < 0 || y >= _panelHeight)
+        return;
+
+    int16_t* current = _errorsCurrent + (x + 1) * 3;
+    int16_t* next = _errorsNext + (x + 1) * 3;
+    int16_t color[3] = {
+        static_cast<int16_t>(std::max(0, std::min(255, r + current[0] / 16))),
+        static_cast<int16_t>(std::max(0, std::min(255, g + current[1] / 16))),
+        static_cast<int16_t>(std::max(0, std::min(255, b + current[2] / 16)))
+    };
+
+    // nearest color of the panel
+    int32_t distance_black = color[0] * color[0] + color[1] * color[1] + color[2] * color[2];
+    int32_t distance_red = (255 - color[0]) * (255 - color[0]) + color[1] * color[1] + color[2] * color[2];
+    int32_t distance_white = (255 - color[0]) * (255 - color[0]) + (255 - color[1]) * (255 - color[1]) + (255 - color[2]) * (255 - color[2]);
+    int16_t quantized[3] = {255, 255, 255};
+
+    // the planes are rotated by 180 degrees to match the panel's RAM for setRotation(2)
+    int32_t panel_x = _panelWidth - 1 - x;
+    int32_t panel_y = _panelHeight - 1 - y;
+    size_t offset = panel_y * _rowBytes + panel_x / 8;
+    uint8_t mask = 0x80 >> (panel_x & 7);
+    if (distance_black <= distance_red && distance_black <= distance_white) {
+        quantized[0] = 0;
+        quantized[1] = 0;
+        quantized[2] = 0;
+        _frame[offset] &= ~mask;
+    } else if (distance_red <= distance_white) {
+        quantized[1] = 0;
+        quantized[2] = 0;
+        _frame[getPlaneSize() + offset] &= ~mask;
+    }
+
+    for (uint8_t c = 0; c < 3; c++) {
+        int16_t error = color[c] - quantized[c];
+        current[3 + c] += error * 7;
+        next[c - 3] += error * 3;
+        next[c] += error * 5;
+        next[3 + c] += error;
+    }
+}
+
+// Move on to the next row of the image
+void Soylent::ImageDitherer::_nextRow() {
+    std::swap(_errorsCurrent, _errorsNext);
+    memset(_errorsNext, 0, 3 * (_panelWidth + 2) * sizeof(int16_t));
+    if (++_row == _height)
+        _state = State::DONE;
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <ePaper.h>
+#include <PanelBus.h>
+#define TAG "PanelBus"
+
+Soylent::PanelBus::PanelBus(int16_t cs, int16_t dc)
+    : _spi(nullptr)
+    , _clock(0)
+    , _cs(cs)
+    , _dc(dc)
+    , _stats({0, 0}) {
+}
+
+// the bus is shared with GxEPD2, both are using the same SPI settings
+void Soylent::PanelBus::begin(SPIClass& spi, uint32_t clock) {
+    _spi = &spi;
+    setClock(clock);
+}
+
+void Soylent::PanelBus::setClock(uint32_t clock) {
+    _clock = clock;
+    _settings = SPISettings(clock, MSBFIRST, SPI_MODE0);
+    LOGD(TAG, "SPI clock: %" PRIu32 " Hz", _clock);
+}
+
+uint32_t Soylent::PanelBus::getClock() {
+    return _clock;
+}
+
+Soylent::PanelBus::panel_bus_stats Soylent::PanelBus::getStats() {
+    return _stats;
+}
+
+void Soylent::PanelBus::resetStats() {
+    _stats = {0, 0};
+}
+
+// Write a command (with optional data), same framing as GxEPD2_EPD::_writeCommand()
+void Soylent::PanelBus::_writeCommand(uint8_t command, const uint8_t* data, size_t length) {
+    _spi->beginTransaction(_settings);
+    if (_dc >= 0) digitalWrite(_dc, LOW);
+    if (_cs >= 0) digitalWrite(_cs, LOW);
+    _spi->transfer(command);
+    _stats.bytes++;
+    _stats.transactions++;
+    if (_dc >= 0) digitalWrite(_dc, HIGH);
+    if (length > 0)
+        _transfer(data, length);
+    if (_cs >= 0) digitalWrite(_cs, HIGH);
+    _spi->endTransaction();
+}
+
+void Soylent::PanelBus::_startTransfer() {
+    _spi->beginTransaction(_settings);
+    if (_cs >= 0) digitalWrite(_cs, LOW);
+}
+
+// Send data in chunks of at most CONFIG_DISPLAY_SPI_CHUNK_BYTES
+void Soylent::PanelBus::_transfer(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        size_t part = std::min<size_t>(length, CONFIG_DISPLAY_SPI_CHUNK_BYTES);
+        _spi->writeBytes(data, part);
+        _stats.bytes += part;
+        _stats.transactions++;
+        data += part;
+        length -= part;
+    }
+}
+
+void Soylent::PanelBus::_endTransfer() {
+    if (_cs >= 0) digitalWrite(_cs, HIGH);
+    _spi->endTransaction();
+}
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <PlaneDecoder.h>
+#include <algorithm>
+
+// the window position is wrapping around as uint8_t
+static_assert(PLANE_DECODER_WINDOW == 256, "LZSS window must match the range of uint8_t");
+
+Soylent::PlaneDecoder::PlaneDecoder()
+    : _file(nullptr)
+    , _offset(0)
+    , _left(0)
+    , _encoding(Encoding::RAW)
+    , _inputPos(0)
+    , _inputFill(0)
+    , _count(0)
+    , _repeat(false)
+    , _value(0)
+    , _flags(0)
+    , _flagBits(0)
+    , _distance(0)
+    , _windowPos(0) {
+}
+
+// Start decoding a plane of size bytes at offset in file
+void Soylent::PlaneDecoder::begin(File& file, uint32_t offset, uint32_t size, Encoding encoding) {
+    _file = &file;
+    _offset = offset;
+    _left = size;
+    _encoding = encoding;
+    _inputPos = 0;
+    _inputFill = 0;
+    _count = 0;
+    _flagBits = 0;
+    _windowPos = 0;
+}
+
+// Decode the next length bytes of the plane, returns the number of bytes decoded
+// ...less than length, when the file is truncated or corrupted
+size_t Soylent::PlaneDecoder::read(uint8_t* dst, size_t length) {
+    // uncompressed planes are read directly
+    if (_encoding == Encoding::RAW) {
+        size_t part = std::min<uint32_t>(length, _left);
+        if (part == 0 || !_file->seek(_offset, fs::SeekMode::SeekSet))
+            return 0;
+        part = _file->read(dst, part);
+        _offset += part;
+        _left -= part;
+        return part;
+    }
+
+    size_t produced = 0;
+    while (produced < length) {
+        int16_t value = _decode();
+        if (value < 0)
+            break;
+        dst[produced++] = value;
+    }
+    return produced;
+}
+
+// Next byte of the plane, -1 at the end of the input
+int16_t Soylent::PlaneDecoder::_decode() {
+    if (_encoding == Encoding::RLE) {
+        while (_count == 0) {
+            int16_t control = _next();
+            if (control < 0)
+                return -1;
+            if (control < 128) {
+                _count = control + 1;
+                _repeat = false;
+            } else if (control > 128) {
+                int16_t value = _next();
+                if (value < 0)
+                    return -1;
+                _count = 257 - control;
+                _repeat = true;
+                _value = value;
+            }
+        }
+        _count--;
+        return _repeat ? _value : _next();
+    }
+
+    // LZSS, decoded bytes are kept in the window for later matches
+    int16_t value;
+    if (_count == 0) {
+        if (_flagBits == 0) {
+            int16_t flags = _next();
+            if (flags < 0)
+                return -1;
+            _flags = flags;
+            _flagBits = 8;
+        }
+        bool literal = _flags & 0x01;
+        _flags >>= 1;
+        _flagBits--;
+        if (literal) {
+            value = _next();
+            if (value < 0)
+                return -1;
+            _window[_windowPos++] = value;
+            return value;
+        }
+        int16_t distance = _next();
+        int16_t length = _next();
+        if (distance < 0 || length < 0)
+            return -1;
+        _distance = distance + 1;
+        _count = length + 3;
+    }
+    _count--;
+    value = _window[static_cast<uint8_t>(_windowPos - _distance)];
+    _window[_windowPos++] = value;
+    return value;
+}
+
+// Next byte of the input, the buffer is refilled from the file when empty
+int16_t Soylent::PlaneDecoder::_next() {
+    if (_inputPos == _inputFill) {
+        size_t part = std::min<uint32_t>(sizeof(_input), _left);
+        if (part == 0 || !_file->seek(_offset, fs::SeekMode::SeekSet))
+            return -1;
+        _inputFill = _file->read(_input, part);
+        _inputPos = 0;
+        if (_inputFill == 0)
+            return -1;
+        _offset += _inputFill;
+        _left -= _inputFill;
+    }
+    return _input[_inputPos++];
+}
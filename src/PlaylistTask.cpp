@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <ePaper.h>
+#define TAG "Playlist"
+
+Soylent::PlaylistClass::PlaylistClass()
+    : _playlistTask(nullptr)
+    , _scheduler(nullptr)
+    , _items{}
+    , _count(0)
+    , _position(0)
+    , _running(false) {
+}
+
+void Soylent::PlaylistClass::begin(Scheduler* scheduler) {
+    _load();
+
+    // Task handling
+    _scheduler = scheduler;
+    _playlistTask = new Task(TASK_IMMEDIATE, TASK_FOREVER, [&] { _playlistCallback(); }, 
+        _scheduler, false, NULL, NULL, true);
+
+    // resume the playlist, as soon as the display is ready
+    if (_running && _count > 0) {
+        LOGI(TAG, "Resuming playlist (%u images)", _count);
+        _playlistTask->enable();
+    }
+}
+
+void Soylent::PlaylistClass::end() {
+    if (_playlistTask != nullptr) {
+        _playlistTask->disable();
+    }
+}
+
+// Replace the items of the playlist, it is stopped when empty
+bool Soylent::PlaylistClass::setItems(const playlist_item* items, size_t count) {
+    if (count > CONFIG_PLAYLIST_SIZE)
+        return false;
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].image_name[0] == '\0' || items[i].dwell_s < CONFIG_PLAYLIST_MIN_DWELL)
+            return false;
+    }
+
+    taskENTER_CRITICAL(&cs_spinlock);
+    memcpy(_items, items, count * sizeof(playlist_item));
+    _count = count;
+    _position = 0;
+    taskEXIT_CRITICAL(&cs_spinlock);
+
+    if (count == 0) {
+        stop();
+    } else if (_running) {
+        // start over with the new items
+        _playlistTask->restart();
+    }
+    return _save();
+}
+
+size_t Soylent::PlaylistClass::getCount() {
+    return _count;
+}
+
+bool Soylent::PlaylistClass::getItem(size_t index, playlist_item& item) {
+    bool found = false;
+    taskENTER_CRITICAL(&cs_spinlock);
+    if (index < _count) {
+        item = _items[index];
+        found = true;
+    }
+    taskEXIT_CRITICAL(&cs_spinlock);
+    return found;
+}
+
+size_t Soylent::PlaylistClass::getPosition() {
+    return _position;
+}
+
+bool Soylent::PlaylistClass::start() {
+    if (_count == 0)
+        return false;
+    if (!_running) {
+        LOGI(TAG, "Starting playlist (%u images)", _count);
+        _running = true;
+        _position = 0;
+        _playlistTask->restart();
+        _save();
+    }
+    return true;
+}
+
+void Soylent::PlaylistClass::stop() {
+    if (_running) {
+        LOGI(TAG, "Stopping playlist");
+        _running = false;
+        _playlistTask->disable();
+        _save();
+    }
+}
+
+bool Soylent::PlaylistClass::isRunning() {
+    return _running;
+}
+
+// Show the next image and wait for its dwell time
+// ...the image after it is handed to the display to be read while the panel is refreshing
+void Soylent::PlaylistClass::_playlistCallback() {
+    playlist_item item;
+    char next_image_name[CONFIG_DISPLAY_IMAGE_NAME_LENGTH];
+    taskENTER_CRITICAL(&cs_spinlock);
+    if (_count == 0) {
+        taskEXIT_CRITICAL(&cs_spinlock);
+        _playlistTask->disable();
+        return;
+    }
+    size_t position = _position % _count;
+    item = _items[position];
+    memcpy(next_image_name, _items[(position + 1) % _count].image_name, sizeof(next_image_name));
+    taskEXIT_CRITICAL(&cs_spinlock);
+
+    if (!Display.showImage(item.image_name, next_image_name)) {
+        LOGW(TAG, "Display not available, retrying...");
+        _playlistTask->setInterval(PLAYLIST_RETRY_DELAY * TASK_SECOND);
+        return;
+    }
+
+    LOGD(TAG, "Showing %s for %" PRIu32 " s", item.image_name, item.dwell_s);
+    Display.setImageIndex(item.img_idx);
+    _position = (position + 1) % _count;
+    _playlistTask->setInterval(item.dwell_s * TASK_SECOND);
+}
+
+// Read the playlist from NVS
+void Soylent::PlaylistClass::_load() {
+    Preferences preferences;
+    preferences.begin("playlist", true);
+    size_t size = preferences.isKey("items") ? preferences.getBytesLength("items") : 0;
+    if (size % sizeof(playlist_item) == 0 && size <= sizeof(_items)) {
+        _count = preferences.getBytes("items", _items, size) / sizeof(playlist_item);
+        for (size_t i = 0; i < _count; i++) {
+            _items[i].image_name[sizeof(_items[i].image_name) - 1] = '\0';
+        }
+    } else {
+        LOGW(TAG, "Stored playlist doesn't match, ignoring it");
+        _count = 0;
+    }
+    _running = preferences.getBool("running", false);
+    preferences.end();
+    _position = 0;
+}
+
+// Write the playlist to NVS
+bool Soylent::PlaylistClass::_save() {
+    Preferences preferences;
+    if (!preferences.begin("playlist", false)) {
+        LOGE(TAG, "Can't open preferences");
+        return false;
+    }
+    playlist_item items[CONFIG_PLAYLIST_SIZE];
+    taskENTER_CRITICAL(&cs_spinlock);
+    size_t count = _count;
+    memcpy(items, _items, count * sizeof(playlist_item));
+    taskEXIT_CRITICAL(&cs_spinlock);
+
+    bool saved = count == 0 ? 
+        (!preferences.isKey("items") || preferences.remove("items")) : 
+        preferences.putBytes("items", items, count * sizeof(playlist_item)) == count * sizeof(playlist_item);
+    saved = saved && preferences.putBool("running", _running) == sizeof(bool);
+    preferences.end();
+    return saved;
+}
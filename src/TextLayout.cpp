@@ -0,0 +1,275 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <ePaper.h>
+#include <TextLayout.h>
+#include "Fonts/FreeSans9pt7b.h"
+#include "Fonts/FreeSans12pt7b.h"
+#include "Fonts/FreeSans18pt7b.h"
+#include "Fonts/FreeSans24pt7b.h"
+#include "Fonts/FreeSansBold9pt7b.h"
+#include "Fonts/FreeSansBold12pt7b.h"
+#include "Fonts/FreeSansBold18pt7b.h"
+#include "Fonts/FreeSansBold24pt7b.h"
+#include "Fonts/FreeMono9pt7b.h"
+#include "Fonts/FreeMono12pt7b.h"
+#include "Fonts/FreeMono18pt7b.h"
+#include "Fonts/FreeMono24pt7b.h"
+#define TAG "TextLayout"
+
+// fonts available for rendering text, the index is the font id
+struct font_entry
+{
+    const char* name;
+    uint8_t size;
+    const GFXfont* font;
+};
+
+static const font_entry fonts[] = {
+    { "sans", 9, &FreeSans9pt7b },
+    { "sans", 12, &FreeSans12pt7b },
+    { "sans", 18, &FreeSans18pt7b },
+    { "sans", 24, &FreeSans24pt7b },
+    { "sansbold", 9, &FreeSansBold9pt7b },
+    { "sansbold", 12, &FreeSansBold12pt7b },
+    { "sansbold", 18, &FreeSansBold18pt7b },
+    { "sansbold", 24, &FreeSansBold24pt7b },
+    { "mono", 9, &FreeMono9pt7b },
+    { "mono", 12, &FreeMono12pt7b },
+    { "mono", 18, &FreeMono18pt7b },
+    { "mono", 24, &FreeMono24pt7b },
+};
+
+// the entries are prepared for texts of up to textLength bytes
+Soylent::TextLayout::TextLayout(size_t textLength)
+    : _uses(0) {
+    for (auto& entry : _cache) {
+        entry.text.reserve(textLength);
+        entry.glyphs.reserve(textLength);
+        entry.lines.reserve(CONFIG_DISPLAY_TEXT_LAYOUT_LINES);
+        entry.last_used = 0;
+    }
+}
+
+// Find a font by name and size (in pt), the closest size of the font family is taken
+uint8_t Soylent::TextLayout::findFont(const char* name, uint8_t size) {
+    uint8_t font_id = TEXT_FONT_INVALID;
+    for (uint8_t i = 0; i < sizeof(fonts) / sizeof(fonts[0]); i++) {
+        if (strcmp(fonts[i].name, name) != 0)
+            continue;
+        if (font_id == TEXT_FONT_INVALID ||
+            abs(fonts[i].size - size) < abs(fonts[font_id].size - size)) {
+            font_id = i;
+        }
+    }
+    return font_id;
+}
+
+const GFXfont* Soylent::TextLayout::getFont(uint8_t fontID) {
+    if (fontID >= sizeof(fonts) / sizeof(fonts[0]))
+        return nullptr;
+    return fonts[fontID].font;
+}
+
+// Get the layout of a text within a box, measuring it only when it's not cached
+const Soylent::TextLayout::text_layout& Soylent::TextLayout::layout(const char* text, uint8_t fontID, uint8_t scale, int16_t boxW, int16_t boxH) {
+    for (auto& entry : _cache) {
+        if (entry.last_used != 0 && entry.font_id == fontID && entry.scale == scale &&
+            entry.box_w == boxW && entry.box_h == boxH && entry.text == text) {
+            // mark as most recently used
+            entry.last_used = ++_uses;
+            return entry;
+        }
+    }
+
+    // re-use the least recently used layout
+    text_layout* least_recently_used = &_cache[0];
+    for (auto& entry : _cache) {
+        if (entry.last_used < least_recently_used->last_used)
+            least_recently_used = &entry;
+    }
+
+    const GFXfont* font = getFont(fontID);
+    text_layout& layout = *least_recently_used;
+    layout.last_used = ++_uses;
+    layout.text.assign(text);
+    layout.font_id = fontID;
+    layout.scale = scale < 1 ? 1 : scale;
+    layout.box_w = boxW;
+    layout.box_h = boxH;
+    _toGlyphs(text, font, layout.glyphs);
+    layout.lines.clear();
+    layout.line_height = font->yAdvance * layout.scale;
+
+    // extent of the font above and below the baseline
+    int16_t ascent = 0;
+    int16_t descent = 0;
+    for (uint16_t c = 0; c <= font->last - font->first; c++) {
+        ascent = std::max<int16_t>(ascent, -font->glyph[c].yOffset);
+        descent = std::max<int16_t>(descent, font->glyph[c].yOffset + font->glyph[c].height);
+    }
+    layout.ascent = ascent * layout.scale;
+    layout.descent = descent * layout.scale;
+
+    _wrap(layout, font);
+    LOGD(TAG, "Layout of %u lines for \"%s\"", layout.lines.size(), text);
+    return layout;
+}
+
+// Render a layout into the box
+void Soylent::TextLayout::render(Adafruit_GFX& gfx, const text_layout& layout,
+                                 int16_t boxX, int16_t boxY, TextAlign align, TextVAlign valign, uint16_t color) {
+    if (layout.lines.empty())
+        return;
+
+    gfx.setFont(getFont(layout.font_id));
+    gfx.setTextSize(layout.scale);
+    gfx.setTextColor(color);
+    gfx.setTextWrap(false);
+
+    // top of the text block
+    int16_t block_h = layout.ascent + (layout.lines.size() - 1) * layout.line_height + layout.descent;
+    int16_t y = boxY;
+    switch (valign) {
+        case TextVAlign::MIDDLE:
+            y += (layout.box_h - block_h) / 2;
+            break;
+        case TextVAlign::BOTTOM:
+            y += layout.box_h - block_h;
+            break;
+        default:
+            break;
+    }
+    y += layout.ascent;
+
+    for (const auto& line : layout.lines) {
+        int16_t x = boxX;
+        switch (align) {
+            case TextAlign::CENTER:
+                x += (layout.box_w - line.width) / 2;
+                break;
+            case TextAlign::RIGHT:
+                x += layout.box_w - line.width;
+                break;
+            default:
+                break;
+        }
+        gfx.setCursor(x, y);
+        for (uint16_t i = 0; i < line.length; i++) {
+            gfx.write(layout.glyphs[line.start + i]);
+        }
+        y += layout.line_height;
+    }
+}
+
+void Soylent::TextLayout::clear() {
+    for (auto& entry : _cache)
+        entry.last_used = 0;
+}
+
+// Decode UTF-8 and map the code points to the glyphs of the font
+// code points not covered by the font are replaced by '?'
+void Soylent::TextLayout::_toGlyphs(const char* text, const GFXfont* font, std::string& glyphs) {
+    glyphs.clear();
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(text);
+    while (*p) {
+        uint32_t code_point;
+        size_t length;
+        if (*p < 0x80) {
+            code_point = *p;
+            length = 1;
+        } else if ((*p & 0xE0) == 0xC0) {
+            code_point = *p & 0x1F;
+            length = 2;
+        } else if ((*p & 0xF0) == 0xE0) {
+            code_point = *p & 0x0F;
+            length = 3;
+        } else if ((*p & 0xF8) == 0xF0) {
+            code_point = *p & 0x07;
+            length = 4;
+        } else {
+            code_point = '?';
+            length = 1;
+        }
+        for (size_t i = 1; i < length; i++) {
+            if ((p[i] & 0xC0) != 0x80) {
+                // truncated sequence
+                code_point = '?';
+                length = i;
+                break;
+            }
+            code_point = (code_point << 6) | (p[i] & 0x3F);
+        }
+        p += length;
+
+        if (code_point == '\n') {
+            glyphs += '\n';
+        } else if (code_point == '\t' || code_point == 0xA0) {
+            glyphs += ' ';
+        } else if (code_point >= font->first && code_point <= font->last) {
+            glyphs += static_cast<char>(code_point);
+        } else if (code_point >= 0x20) {
+            glyphs += '?';
+        }
+    }
+}
+
+// Width of a run of glyphs in pixels
+uint16_t Soylent::TextLayout::_measure(const std::string& glyphs, size_t start, size_t length, const GFXfont* font, uint8_t scale) {
+    uint16_t width = 0;
+    for (size_t i = start; i < start + length; i++) {
+        uint8_t c = glyphs[i];
+        if (c >= font->first && c <= font->last)
+            width += font->glyph[c - font->first].xAdvance * scale;
+    }
+    return width;
+}
+
+// Break the glyphs into lines fitting into the box
+// lines are broken at spaces (or within a word, when it's too long) and at explicit line breaks
+void Soylent::TextLayout::_wrap(text_layout& layout, const GFXfont* font) {
+    const std::string& glyphs = layout.glyphs;
+    size_t max_lines = std::max<int16_t>(1, layout.box_h / std::max<int16_t>(1, layout.line_height));
+    size_t paragraph_start = 0;
+
+    while (paragraph_start <= glyphs.size() && layout.lines.size() < max_lines) {
+        size_t paragraph_end = glyphs.find('\n', paragraph_start);
+        if (paragraph_end == std::string::npos)
+            paragraph_end = glyphs.size();
+
+        size_t start = paragraph_start;
+        do {
+            // fill the line as far as possible
+            size_t last_space = std::string::npos;
+            uint16_t width = 0;
+            size_t end = start;
+            while (end < paragraph_end) {
+                uint16_t advance = _measure(glyphs, end, 1, font, layout.scale);
+                if (width + advance > layout.box_w && end > start)
+                    break;
+                width += advance;
+                if (glyphs[end] == ' ')
+                    last_space = end;
+                end++;
+            }
+            if (end < paragraph_end && last_space != std::string::npos && last_space > start)
+                end = last_space;
+
+            // trailing spaces are not part of the line
+            size_t line_end = end;
+            while (line_end > start && glyphs[line_end - 1] == ' ')
+                line_end--;
+            layout.lines.push_back({static_cast<uint16_t>(start),
+                                    static_cast<uint16_t>(line_end - start),
+                                    _measure(glyphs, start, line_end - start, font, layout.scale)});
+
+            // leading spaces of a wrapped line are skipped
+            start = end;
+            while (start < paragraph_end && glyphs[start] == ' ')
+                start++;
+        } while (start < paragraph_end && layout.lines.size() < max_lines);
+
+        paragraph_start = paragraph_end + 1;
+    }
+}
@@ -3,18 +3,17 @@
  * Copyright (C) 2024 Robert Wendlandt
  */
 #include <ePaper.h>
+#include <EmbeddedAssets.h>
 #include <esp_ota_ops.h>
 #include <esp_partition.h>
 
 #define TAG "WebServer"
 
-// gzipped assets
-extern const uint8_t logo_start[] asm("_binary__pio_assets_logo_captive_svg_gz_start");
-extern const uint8_t logo_end[] asm("_binary__pio_assets_logo_captive_svg_gz_end");
-
 Soylent::WebServerClass::WebServerClass(AsyncWebServer& webServer)
     : _scheduler(nullptr)
-    , _webServer(&webServer) {
+    , _webServer(&webServer)
+    , _asset(nullptr)
+    , _assetRequest(nullptr) {
     _sr.setWaiting();
 }
 
@@ -44,14 +43,37 @@ void Soylent::WebServerClass::end() {
 void Soylent::WebServerClass::_webServerCallback() {
     LOGD(TAG, "Starting WebServer...");
 
-    // serve the logo (for captive portal)
-    _webServer->on("/logo", HTTP_GET, [&](AsyncWebServerRequest* request) {
-        LOGD(TAG, "Serve captive logo...");
-        AsyncWebServerResponse* response = request->beginResponse(200, "image/svg+xml", logo_start, logo_end - logo_start);
-        response->addHeader("Content-Encoding", "gzip");
-        response->addHeader("Cache-Control", "public, max-age=900");
+    // serve the embedded assets (see tools/assets.py) by a single handler, revalidated by their hash
+    // the assets of the captive portal are served only while it's shown, the ones of the website only when it isn't
+    // the home page changes with every build, the others are cached for a day
+    // the asset is looked up once by the filter (request->_tempObject can't hold it, it's freed with the request)
+    _webServer->on("/*", HTTP_GET, [&](AsyncWebServerRequest* request) {
+        const Soylent::embedded_asset* asset = _assetRequest == request ? 
+            _asset : Soylent::find_embedded_asset(request->url().c_str());
+        _assetRequest = nullptr;
+        if (asset == nullptr) {
+            request->send(404, "text/plain", "Not found");
+            return;
+        }
+        LOGD(TAG, "Serve %s...", asset->path);
+        AsyncWebServerResponse* response;
+        if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset->etag) {
+            response = request->beginResponse(304);
+        } else {
+            response = request->beginResponse(200, asset->mime_type, asset->data, asset->size);
+            response->addHeader("Content-Encoding", asset->encoding);
+        }
+        response->addHeader("ETag", asset->etag);
+        response->addHeader("Cache-Control", strcmp(asset->mime_type, "text/html") == 0 ? "no-cache" : "public, max-age=86400");
         request->send(response);
-    }).setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() == Mycila::ESPConnect::State::PORTAL_STARTED; });
+    }).setFilter([&](AsyncWebServerRequest* request) {
+        const Soylent::embedded_asset* asset = Soylent::find_embedded_asset(request->url().c_str());
+        if (asset == nullptr || asset->portal != (EventHandler.getState() == Mycila::ESPConnect::State::PORTAL_STARTED))
+            return false;
+        _asset = asset;
+        _assetRequest = request;
+        return true;
+    });
 
     // clear persisted wifi config
     _webServer->on("/clearwifi", HTTP_GET, [&](AsyncWebServerRequest* request) {
@@ -5,25 +5,18 @@
 #include <ePaper.h>
 #define TAG "website"
 
-// gzipped assets
-extern const uint8_t logo_thingy_start[] asm("_binary__pio_assets_logo_thingy_svg_gz_start");
-extern const uint8_t logo_thingy_end[] asm("_binary__pio_assets_logo_thingy_svg_gz_end");
-extern const uint8_t touchicon_start[] asm("_binary__pio_assets_apple_touch_icon_png_gz_start");
-extern const uint8_t touchicon_end[] asm("_binary__pio_assets_apple_touch_icon_png_gz_end");
-extern const uint8_t favicon_svg_start[] asm("_binary__pio_assets_favicon_svg_gz_start");
-extern const uint8_t favicon_svg_end[] asm("_binary__pio_assets_favicon_svg_gz_end");
-extern const uint8_t favicon_96_png_start[] asm("_binary__pio_assets_favicon_96x96_png_gz_start");
-extern const uint8_t favicon_96_png_end[] asm("_binary__pio_assets_favicon_96x96_png_gz_end");
-extern const uint8_t favicon_32_png_start[] asm("_binary__pio_assets_favicon_32x32_png_gz_start");
-extern const uint8_t favicon_32_png_end[] asm("_binary__pio_assets_favicon_32x32_png_gz_end");
-extern const uint8_t thingy_html_start[] asm("_binary__pio_assets_thingy_html_gz_start");
-extern const uint8_t thingy_html_end[] asm("_binary__pio_assets_thingy_html_gz_end");
-
 Soylent::WebSiteClass::WebSiteClass(AsyncWebServer& webServer)
-    : _imageIdx(0)
-    , _showImageHandler(nullptr)
-    , _imagesJson(nullptr)
-    , _imageCount(1)
+    : _showImageHandler(nullptr)
+    , _printTextHandler(nullptr)
+    , _composeHandler(nullptr)
+    , _playlistHandler(nullptr)
+    , _displayEvents(nullptr)
+    , _displayEventsTask(nullptr)
+    , _displayVersions{}
+    , _upload(nullptr)
+    , _uploadRequest(nullptr)
+    , _fileUploadRequest(nullptr)
+    , _fileUploadFailed(false)
     , _scheduler(nullptr)
     , _webServer(&webServer) {
 }
@@ -46,38 +39,220 @@ void Soylent::WebSiteClass::end() {
         delete _showImageHandler;
         _showImageHandler = nullptr;
     }
-    if (_imagesJson != nullptr) {
-        delete _imagesJson;
-        _imagesJson = nullptr;
+    if (_printTextHandler != nullptr) {
+        delete _printTextHandler;
+        _printTextHandler = nullptr;
+    }
+    if (_composeHandler != nullptr) {
+        delete _composeHandler;
+        _composeHandler = nullptr;
+    }
+    if (_playlistHandler != nullptr) {
+        delete _playlistHandler;
+        _playlistHandler = nullptr;
+    }
+    if (_displayEventsTask != nullptr) {
+        _displayEventsTask->disable();
+        _displayEventsTask = nullptr;
+    }
+    if (_displayEvents != nullptr) {
+        delete _displayEvents;
+        _displayEvents = nullptr;
+    }
+    _releaseUpload();
+    _releaseFileUpload(true);
+}
+
+// Image names are used as file names, only [A-Za-z0-9_-] are allowed
+bool Soylent::WebSiteClass::_isValidImageName(AsyncWebServerRequest* request) {
+    if (!request->hasParam("name"))
+        return false;
+    const String& name = request->getParam("name")->value();
+    if (name.length() == 0 || name.length() > CONFIG_WEBSITE_IMAGE_NAME_LENGTH)
+        return false;
+    for (size_t i = 0; i < name.length(); i++) {
+        char c = name[i];
+        if (!isalnum(c) && c != '_' && c != '-')
+            return false;
+    }
+    return true;
+}
+
+// Uploaded files are stored in the root of LittleFS, only [A-Za-z0-9_-.] and known extensions are allowed
+bool Soylent::WebSiteClass::_isValidFileName(const String& fileName) {
+    if (fileName.length() == 0 || fileName.length() > CONFIG_WEBSITE_IMAGE_NAME_LENGTH || fileName[0] == '.' || fileName.indexOf("..") >= 0)
+        return false;
+    for (size_t i = 0; i < fileName.length(); i++) {
+        char c = fileName[i];
+        if (!isalnum(c) && c != '_' && c != '-' && c != '.')
+            return false;
+    }
+    return fileName.endsWith(".epd") || fileName.endsWith(".svg") || fileName.endsWith(".bmp");
+}
+
+// Only authorized users are allowed to change the content of LittleFS
+bool Soylent::WebSiteClass::_isAuthorized(AsyncWebServerRequest* request) {
+    return request->authenticate(WEBSITE_UPLOAD_USER, WEBSITE_UPLOAD_PASSWORD);
+}
+
+// ID of the panel a request is meant for, given as parameter "panel" (the first panel by default)
+// returns -1 for unknown panels
+int32_t Soylent::WebSiteClass::_getPanelId(AsyncWebServerRequest* request) {
+    if (!request->hasParam("panel"))
+        return 0;
+    int32_t panel = request->getParam("panel")->value().toInt();
+    return panel >= 0 && panel < CONFIG_DISPLAY_COUNT ? panel : -1;
+}
+
+// ...or as member "panel" of a JSON body
+int32_t Soylent::WebSiteClass::_getPanelId(JsonObject root) {
+    int32_t panel = root["panel"] | 0;
+    return panel >= 0 && panel < CONFIG_DISPLAY_COUNT ? panel : -1;
+}
+
+// Style of a text (or the box and color of a layer), missing members are defaulting to a centered text on the whole panel
+void Soylent::WebSiteClass::_getTextStyle(JsonObject root, Soylent::text_style& style) {
+    style.font_id = Soylent::TextLayout::findFont(root["font"] | "sans", root["size"] | 12);
+    style.scale = root["scale"] | 1;
+    const char* align = root["align"] | "center";
+    style.align = strcmp(align, "left") == 0 ? Soylent::TextAlign::LEFT :
+                  strcmp(align, "right") == 0 ? Soylent::TextAlign::RIGHT : Soylent::TextAlign::CENTER;
+    const char* valign = root["valign"] | "middle";
+    style.valign = strcmp(valign, "top") == 0 ? Soylent::TextVAlign::TOP :
+                   strcmp(valign, "bottom") == 0 ? Soylent::TextVAlign::BOTTOM : Soylent::TextVAlign::MIDDLE;
+    const char* color = root["color"] | "black";
+    style.color = strcmp(color, "red") == 0 ? GxEPD_RED :
+                  strcmp(color, "white") == 0 ? GxEPD_WHITE : GxEPD_BLACK;
+    style.box_x = root["box"]["x"] | 0;
+    style.box_y = root["box"]["y"] | 0;
+    style.box_w = root["box"]["w"] | static_cast<int16_t>(Soylent::PanelDisplayClass::WIDTH);
+    style.box_h = root["box"]["h"] | static_cast<int16_t>(Soylent::PanelDisplayClass::HEIGHT);
+}
+
+// Close the file being uploaded, the temporary files are removed when the upload failed
+void Soylent::WebSiteClass::_releaseFileUpload(bool removeFiles) {
+    if (_fileUpload) {
+        _fileUpload.close();
+    }
+    if (removeFiles) {
+        for (const auto& file_name : _fileUploadNames) {
+            LittleFS.remove(("/" + file_name + ".tmp").c_str());
+        }
+    }
+    _fileUploadNames.clear();
+    _fileUploadRequest = nullptr;
+}
+
+// Move the uploaded files into place, all of them or none
+// replaced files are kept as backups until all are moved, they are restored when one of them can't be moved
+bool Soylent::WebSiteClass::_moveFileUpload() {
+    size_t moved = 0;
+    for (; moved < _fileUploadNames.size(); moved++) {
+        std::string final_name = "/" + _fileUploadNames[moved];
+        std::string backup_name = final_name + ".bak";
+        LittleFS.remove(backup_name.c_str());
+        if (LittleFS.exists(final_name.c_str()) && !LittleFS.rename(final_name.c_str(), backup_name.c_str())) {
+            LOGE(TAG, "Can't back up %s", final_name.c_str());
+            break;
+        }
+        if (!LittleFS.rename((final_name + ".tmp").c_str(), final_name.c_str())) {
+            LOGE(TAG, "Can't rename %s", final_name.c_str());
+            if (LittleFS.exists(backup_name.c_str()))
+                LittleFS.rename(backup_name.c_str(), final_name.c_str());
+            break;
+        }
+    }
+
+    bool complete = moved == _fileUploadNames.size();
+    for (size_t i = 0; i < moved; i++) {
+        std::string final_name = "/" + _fileUploadNames[i];
+        std::string backup_name = final_name + ".bak";
+        if (complete) {
+            LittleFS.remove(backup_name.c_str());
+        } else {
+            LittleFS.remove(final_name.c_str());
+            if (LittleFS.exists(backup_name.c_str()))
+                LittleFS.rename(backup_name.c_str(), final_name.c_str());
+        }
     }
+    return complete;
+}
+
+// Add an image to the images.json (or rename an existing entry)
+// the catalog is written to a temporary file and moved into place, then the one in memory is changed
+bool Soylent::WebSiteClass::_updateCatalog(const char* name, const char* image) {
+    // the website is showing the svg, the display is using the panel image (or bitmaps) of the same base name
+    std::string src = "/images/" + std::string(image) + ".svg";
+    if (!_catalog.update("/images.json", name, src.c_str()))
+        return false;
+    LOGI(TAG, "images.json updated (%u images)", _catalog.size());
+    return true;
+}
+
+// State of a panel as pushed to /display/events, which is the state of /display/state along with the panel's ID
+size_t Soylent::WebSiteClass::_getDisplayEvent(int32_t panel, char* buffer, size_t size, uint32_t& version) {
+    char state[CONFIG_DISPLAY_STATE_LENGTH];
+    Displays[panel]->getState(state, sizeof(state), version);
+    return snprintf(buffer, size, "{\"panel\":%" PRId32 ",%s", panel, state + 1);
+}
+
+// Push changes of the panels' state to the clients of /display/events
+void Soylent::WebSiteClass::_displayEventsCallback() {
+    for (int32_t panel = 0; panel < CONFIG_DISPLAY_COUNT; panel++) {
+        uint32_t version = Displays[panel]->getStateVersion();
+        if (version == _displayVersions[panel])
+            continue;
+        if (_displayEvents->count() == 0) {
+            _displayVersions[panel] = version;
+            continue;
+        }
+        char buffer[DISPLAY_EVENT_LENGTH];
+        _getDisplayEvent(panel, buffer, sizeof(buffer), _displayVersions[panel]);
+        _displayEvents->send(buffer, "state", millis());
+    }
+}
+
+// Serve a file of LittleFS with its content hash as ETag
+// the file isn't opened when the client has it already (If-None-Match)
+void Soylent::WebSiteClass::_serveFile(AsyncWebServerRequest* request, const char* path) {
+    uint32_t hash;
+    if (path[0] != '/' || strstr(path, "..") != nullptr || !_fileTags.get(path, hash)) {
+        request->send(404, "text/plain", "Not found");
+        return;
+    }
+
+    char etag[12];
+    snprintf(etag, sizeof(etag), "\"%08" PRIx32 "\"", hash);
+    AsyncWebServerResponse* response;
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+        response = request->beginResponse(304);
+    } else {
+        response = request->beginResponse(LittleFS, path);
+    }
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
+
+void Soylent::WebSiteClass::_releaseUpload() {
+    if (_upload != nullptr) {
+        delete _upload;
+        _upload = nullptr;
+    }
+    _uploadRequest = nullptr;
 }
 
 // Add Handlers to the webserver
 void Soylent::WebSiteClass::_webSiteCallback() {
     LOGD(TAG, "Starting WebSite...");
 
-    // try reading /images.json
+    // try reading /images.json, it's parsed into the catalog once
     LOGD(TAG, "Reading images.json...");
-    File file = LittleFS.open("/images.json", "r");
-    if (!file || file.isDirectory()) { 
-        LOGE(TAG, "An Error has occurred while reading images.json!"); 
+    if (!_catalog.load("/images.json")) {
+        LOGE(TAG, "An Error has occurred while reading images.json!");
     } else {
-        std::string fileContent;
-        _imagesJson = new JsonDocument();
-        while (file.available()) {
-            char intRead = file.read();
-            fileContent += intRead;
-        }            
-        file.close();
-        deserializeJson(*_imagesJson, fileContent);
-        _imagesJson->shrinkToFit();
-        if (!_imagesJson->as<JsonObject>()["images"].is<JsonArray>()) {
-            LOGE(TAG, "An Error has occurred while parsing images.json for images!");
-        } else {
-            _imageCount =  _imagesJson->as<JsonObject>()["images"].as<JsonArray>().size();
-            LOGI(TAG, "images.json seems fine! (%d images)", _imageCount);
-            _fsMounted = true;
-        }
+        LOGI(TAG, "images.json seems fine! (%u images)", _catalog.size());
+        _fsMounted = true;
     }
 
     // Prepare handler for showing images
@@ -87,132 +262,569 @@ void Soylent::WebSiteClass::_webSiteCallback() {
     _showImageHandler->onRequest([&] (AsyncWebServerRequest* request, JsonVariant& json ) {
         LOGD(TAG, "Serve /display/showimage");
         auto img_idx = json.as<JsonObject>()["img_idx"].as<int32_t>();
-        auto img_idx_max = _imagesJson->as<JsonObject>()["images"].as<JsonArray>().size();
-        LOGD(TAG, "Got img_idx: %d", img_idx);
-        if (Display.isBusy() || !Display.isInitialized()) {
+        auto img_idx_max = static_cast<int32_t>(_catalog.size());
+        auto panel = _getPanelId(json.as<JsonObject>());
+        LOGD(TAG, "Got img_idx: %" PRId32 " (panel %" PRId32 ")", img_idx, panel);
+        if (panel < 0) {
+            request->send(404, "text/plain", "Unknown panel");
+        } else if (!Displays[panel]->isInitialized()) {
             LOGW(TAG, "Not available right now");
             request->send(503, "text/plain", "Display not available right now");
         } else if (img_idx < 0 || img_idx > img_idx_max) {
             LOGW(TAG, "img_idx out of bounds");
             request->send(418, "text/plain", "img_idx out of bounds");
         } else {
+            // commands are queued while the display is busy, the latest one wins
+            bool queued = false;
             switch (img_idx) {
                 case 0: 
                     // 0 is hardcoded to wiping
                     // not part of the images.json but embedded in the html-code
                     LOGI(TAG, "I want to wipe!");                  
-                    Display.wipeDisplay();
-                    _imageIdx = img_idx;                  
+                    queued = Displays[panel]->wipeDisplay();
                     break;
                 case 1:    
                     // 1 & 2 are hardcoded to printing text
                     // a svg is present only for display on the website  
                     // the epaper is written with text                   
                     LOGI(TAG, "I want to print in black!");                  
-                    Display.printCenteredTag(NAME_TAG_BLACK);
-                    _imageIdx = img_idx;                  
+                    queued = Displays[panel]->printCenteredTag(NAME_TAG_BLACK);
                     break;
                 case 2: 
                     // 1 & 2 are hardcoded to printing text
                     // a svg is present only for display on the website  
                     // the epaper is written with text    
                     LOGI(TAG, "I want to print in red!");                 
-                    Display.printCenteredTag(NAME_TAG_RED);
-                    _imageIdx = img_idx;                  
+                    queued = Displays[panel]->printCenteredTag(NAME_TAG_RED);
                     break;
                 default: {
                     // show an image from littleFS
                     LOGI(TAG, "I want to show an image!"); 
-                    auto img_name = _imagesJson->as<JsonObject>()["images"].as<JsonArray>()[img_idx-1].as<JsonObject>()["src"];
-                    Display.showImage(img_name);  
-                    _imageIdx = img_idx;
+                    queued = Displays[panel]->showImage(_catalog.get(img_idx)->src);
                 }                    
             }
             
-            request->send(200, "text/plain", "OK");           
+            if (queued) {
+                // choosing an image stops the playlist (which is shown on the first panel)
+                if (panel == 0)
+                    Playlist.stop();
+                Displays[panel]->setImageIndex(img_idx);
+                request->send(200, "text/plain", "OK");           
+            } else {
+                LOGW(TAG, "Not available right now");
+                request->send(503, "text/plain", "Display not available right now");
+            }
         }        
     }); 
 
     // Register handler for showing images
     _webServer->addHandler(_showImageHandler);
 
-    // serve from File System
-    _webServer->serveStatic("/images/", LittleFS, "/").setFilter([&](__unused AsyncWebServerRequest* request) { return _fsMounted; });
+    // Prepare handler for printing text
+    // {"text": "...", "font": "sans", "size": 12, "scale": 1, "align": "center", "valign": "middle", 
+    //  "color": "black", "box": {"x": 0, "y": 0, "w": 200, "h": 200}, "panel": 0}
+    _printTextHandler = new AsyncCallbackJsonWebHandler("/display/text");
+    _printTextHandler->setMethod(HTTP_PUT);
+    _printTextHandler->setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED; });
+    _printTextHandler->onRequest([&] (AsyncWebServerRequest* request, JsonVariant& json ) {
+        LOGD(TAG, "Serve /display/text");
+        JsonObject root = json.as<JsonObject>();
+        auto panel = _getPanelId(root);
+        if (panel < 0) {
+            request->send(404, "text/plain", "Unknown panel");
+            return;
+        }
+        if (!Displays[panel]->isInitialized()) {
+            LOGW(TAG, "Not available right now");
+            request->send(503, "text/plain", "Display not available right now");
+            return;
+        }
+        if (!root["text"].is<const char*>()) {
+            request->send(400, "text/plain", "text is missing");
+            return;
+        }
+
+        Soylent::text_style style = {};
+        _getTextStyle(root, style);
+
+        // commands are queued while the display is busy, the latest one wins
+        if (Displays[panel]->printText(root["text"].as<const char*>(), style)) {
+            // text is not part of the images.json
+            if (panel == 0)
+                Playlist.stop();
+            Displays[panel]->setImageIndex(-1);
+            request->send(200, "text/plain", "OK");
+        } else {
+            LOGW(TAG, "Can't print text");
+            request->send(Displays[panel]->isInitialized() ? 400 : 503, "text/plain", "Can't print text");
+        }
+    });
+
+    // Register handler for printing text
+    _webServer->addHandler(_printTextHandler);
+
+    // Prepare handler for composing an image and layers, shown with a single refresh
+    // {"img_idx": 3, "layers": [{"type": "text", "text": "...", <style as for /display/text>}, 
+    //  {"type": "rect", "color": "white", "box": {...}}, {"type": "icon", "src": "<name of .epd>", "box": {"x": 0, "y": 0}}], "panel": 0}
+    // without img_idx, the layers are drawn on a blank frame
+    _composeHandler = new AsyncCallbackJsonWebHandler("/display/compose");
+    _composeHandler->setMethod(HTTP_PUT);
+    _composeHandler->setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED && _fsMounted; });
+    _composeHandler->onRequest([&] (AsyncWebServerRequest* request, JsonVariant& json ) {
+        LOGD(TAG, "Serve /display/compose");
+        JsonObject root = json.as<JsonObject>();
+        auto panel = _getPanelId(root);
+        if (panel < 0) {
+            request->send(404, "text/plain", "Unknown panel");
+            return;
+        }
+        if (!Displays[panel]->isInitialized()) {
+            LOGW(TAG, "Not available right now");
+            request->send(503, "text/plain", "Display not available right now");
+            return;
+        }
+
+        // only images from the images.json (not the hardcoded text) can be the background
+        const char* img_name = "";
+        int32_t img_idx = root["img_idx"] | 0;
+        if (img_idx != 0) {
+            const Soylent::ImageCatalog::catalog_entry* entry = img_idx > 2 ? _catalog.get(img_idx) : nullptr;
+            if (entry == nullptr || entry->src[0] == '\0') {
+                request->send(400, "text/plain", "img_idx out of bounds");
+                return;
+            }
+            img_name = entry->src;
+        }
+
+        JsonArray entries = root["layers"].as<JsonArray>();
+        if (entries.size() > CONFIG_DISPLAY_LAYERS) {
+            request->send(400, "text/plain", "Too many layers");
+            return;
+        }
+        Soylent::display_layer layers[CONFIG_DISPLAY_LAYERS] = {};
+        size_t count = 0;
+        for (JsonObject entry : entries) {
+            Soylent::display_layer& layer = layers[count++];
+            const char* type = entry["type"] | "text";
+            _getTextStyle(entry, layer.style);
+            if (strcmp(type, "rect") == 0) {
+                layer.type = Soylent::LayerType::RECT;
+            } else if (strcmp(type, "icon") == 0) {
+                layer.type = Soylent::LayerType::ICON;
+                layer.content = entry["src"] | "";
+            } else {
+                layer.type = Soylent::LayerType::TEXT;
+                layer.content = entry["text"] | "";
+            }
+        }
+
+        // commands are queued while the display is busy, the latest one wins
+        if (Displays[panel]->showComposition(img_name, layers, count)) {
+            // compositions are not part of the images.json
+            if (panel == 0)
+                Playlist.stop();
+            Displays[panel]->setImageIndex(-1);
+            request->send(200, "text/plain", "OK");
+        } else {
+            LOGW(TAG, "Can't compose");
+            request->send(Displays[panel]->isInitialized() ? 400 : 503, "text/plain", "Can't compose");
+        }
+    });
+
+    // Register handler for composing
+    _webServer->addHandler(_composeHandler);
 
-    // serve from File System
-    _webServer->serveStatic("/images.json", LittleFS, "/images.json", "no-store").setFilter([&](__unused AsyncWebServerRequest* request) { return _fsMounted; });
+    // serve request for uploading an image, which is dithered to black/red/white while being received
+    // POST /display/upload?name=<name>[&format=bmp|rgb][&width=<width>&height=<height>][&show=1][&panel=<id>]
+    // the body is a 24/32 bit bitmap or raw RGB888 (which needs width and height), stored as /<name>.epd
+    _webServer->on("/display/upload", HTTP_POST, [&](AsyncWebServerRequest* request) {
+        LOGD(TAG, "Serve /display/upload");
+        if (!_isAuthorized(request)) {
+            request->requestAuthentication();
+            return;
+        }
+        if (_uploadRequest != request) {
+            // the upload was never started
+            if (!_isValidImageName(request)) {
+                request->send(400, "text/plain", "Invalid image name");
+            } else if (_upload != nullptr) {
+                request->send(409, "text/plain", "Another upload is in progress");
+            } else {
+                request->send(400, "text/plain", "No image data (send as application/octet-stream)");
+            }
+            return;
+        }
+
+        if (_upload->isOutOfMemory()) {
+            request->send(507, "text/plain", "Out of memory");
+            _releaseUpload();
+            return;
+        }
+        if (!_upload->isComplete()) {
+            request->send(400, "text/plain", _upload->getError());
+            _releaseUpload();
+            return;
+        }
+
+        std::string file_name = "/" + std::string(request->getParam("name")->value().c_str()) + ".epd";
+        if (!_upload->save(file_name.c_str())) {
+            request->send(500, "text/plain", "Can't store image");
+            _releaseUpload();
+            return;
+        }
+        _releaseUpload();
+
+        // drop cached frames (and ETags) of the replaced image
+        _fileTags.clear();
+        for (auto display : Displays) {
+            display->invalidateImageCache();
+        }
+        auto panel = _getPanelId(request);
+        if (panel >= 0 && request->hasParam("show") && request->getParam("show")->value() == "1" && Displays[panel]->showImage(file_name.c_str())) {
+            // uploaded images are not part of the images.json
+            if (panel == 0)
+                Playlist.stop();
+            Displays[panel]->setImageIndex(-1);
+        }
+        request->send(200, "text/plain", "OK");
+    }, nullptr, [&](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, __unused size_t total) {
+        if (index == 0) {
+            // one upload at a time
+            if (_upload != nullptr || !_isAuthorized(request) || !_isValidImageName(request))
+                return;
+
+            Soylent::ImageDitherer::Format format = Soylent::ImageDitherer::Format::BMP;
+            uint16_t width = 0;
+            uint16_t height = 0;
+            if (request->hasParam("format") && request->getParam("format")->value() == "rgb") {
+                format = Soylent::ImageDitherer::Format::RGB;
+                width = request->hasParam("width") ? request->getParam("width")->value().toInt() : 0;
+                height = request->hasParam("height") ? request->getParam("height")->value().toInt() : 0;
+            }
+            _upload = new Soylent::ImageDitherer(Soylent::PanelDisplayClass::WIDTH, Soylent::PanelDisplayClass::HEIGHT);
+            _uploadRequest = request;
+            _upload->begin(format, width, height);
+            request->onDisconnect([this, request]() {
+                if (_uploadRequest == request)
+                    _releaseUpload();
+            });
+        }
+        if (_uploadRequest == request) {
+            _upload->write(data, len);
+        }
+    }).setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED && _fsMounted; });
+
+    // serve request for uploading images (multipart/form-data) into LittleFS and adding them to the images.json
+    // files (*.epd, *.svg, *.bmp) are streamed into temporary files and only moved into place when all are complete
+    // the optional fields "image" (base name of the files) and "name" (shown on the website) are used for the catalog
+    _webServer->on("/images/upload", HTTP_POST, [&](AsyncWebServerRequest* request) {
+        LOGD(TAG, "Serve /images/upload");
+        if (!_isAuthorized(request)) {
+            request->requestAuthentication();
+            return;
+        }
+        if (_fileUploadRequest != request) {
+            if (_fileUploadRequest != nullptr) {
+                request->send(409, "text/plain", "Another upload is in progress");
+            } else {
+                request->send(400, "text/plain", "No files or not enough space");
+            }
+            return;
+        }
+        if (_fileUploadFailed || _fileUploadNames.empty()) {
+            _releaseFileUpload(true);
+            request->send(400, "text/plain", "Invalid or incomplete files");
+            return;
+        }
+
+        // base name of the image, taken from the first file when not given
+        // ...the website can only show the svg of an image, it's uploaded along or there already
+        std::string image = request->hasParam("image", true) ?
+            request->getParam("image", true)->value().c_str() :
+            _fileUploadNames.front().substr(0, _fileUploadNames.front().find('.'));
+        std::string name = request->hasParam("name", true) ? request->getParam("name", true)->value().c_str() : image;
+        std::string svg_name = image + ".svg";
+        if (std::find(_fileUploadNames.begin(), _fileUploadNames.end(), svg_name) == _fileUploadNames.end() &&
+            !LittleFS.exists(("/" + svg_name).c_str())) {
+            _releaseFileUpload(true);
+            request->send(400, "text/plain", "No svg of the image for the website");
+            return;
+        }
+
+        // move all files into place (or none), their ETags (and the catalog's) are changing
+        if (!_moveFileUpload()) {
+            _releaseFileUpload(true);
+            request->send(500, "text/plain", "Can't store files");
+            return;
+        }
+        _fileTags.clear();
+        _releaseFileUpload(false);
+
+        // drop cached frames of replaced images
+        for (auto display : Displays) {
+            display->invalidateImageCache();
+        }
+        if (!_updateCatalog(name.c_str(), image.c_str())) {
+            request->send(500, "text/plain", "Can't update images.json");
+            return;
+        }
+        request->send(200, "text/plain", "OK");
+    }, [&](AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final) {
+        if (index == 0) {
+            // the first file of a request, one upload at a time
+            if (_fileUploadRequest == nullptr) {
+                if (!_isAuthorized(request) ||
+                    request->contentLength() > LittleFS.totalBytes() - LittleFS.usedBytes())
+                    return;
+                _fileUploadRequest = request;
+                _fileUploadFailed = false;
+                _fileUploadNames.clear();
+                request->onDisconnect([this, request]() {
+                    if (_fileUploadRequest == request)
+                        _releaseFileUpload(true);
+                });
+            }
+            if (_fileUploadRequest != request || _fileUploadFailed)
+                return;
+            if (!_isValidFileName(filename)) {
+                LOGW(TAG, "Invalid file name: %s", filename.c_str());
+                _fileUploadFailed = true;
+                return;
+            }
+            _fileUploadNames.push_back(filename.c_str());
+            _fileUpload = LittleFS.open(("/" + _fileUploadNames.back() + ".tmp").c_str(), "w");
+            if (!_fileUpload) {
+                _fileUploadFailed = true;
+                return;
+            }
+        }
+        if (_fileUploadRequest != request || _fileUploadFailed)
+            return;
+
+        // stream the chunk into the temporary file
+        if (index + len > CONFIG_WEBSITE_UPLOAD_FILE_SIZE || _fileUpload.write(data, len) != len) {
+            LOGW(TAG, "Can't write %s", filename.c_str());
+            _fileUploadFailed = true;
+            _fileUpload.close();
+            return;
+        }
+        if (final) {
+            _fileUpload.close();
+        }
+    }).setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED && _fsMounted; });
+
+    // serve from File System, revalidated by the content hash
+    // GET /images/<file>
+    _webServer->on("/images/*", HTTP_GET, [&](AsyncWebServerRequest* request) {
+        _serveFile(request, request->url().c_str() + strlen("/images"));
+    }).setFilter([&](__unused AsyncWebServerRequest* request) { return _fsMounted; });
+
+    // serve from File System, revalidated by the content hash (which changes with the catalog)
+    _webServer->on("/images.json", HTTP_GET, [&](AsyncWebServerRequest* request) {
+        _serveFile(request, "/images.json");
+    }).setFilter([&](__unused AsyncWebServerRequest* request) { return _fsMounted; });
     
-    // serve request for display state
+    // push the state of the panels while it's changing (server-sent events), instead of being polled for it
+    // each event "state" is {"panel": 0, "state": "in_progress", "img_idx": 3, "job": "show_image", "refreshing": true},
+    // a client gets the state of all panels when connecting
+    _displayEvents = new AsyncEventSource("/display/events");
+    _displayEvents->setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED; });
+    _displayEvents->onConnect([&](AsyncEventSourceClient* client) {
+        LOGD(TAG, "Client connected to /display/events");
+        for (int32_t panel = 0; panel < CONFIG_DISPLAY_COUNT; panel++) {
+            char buffer[DISPLAY_EVENT_LENGTH];
+            uint32_t version;
+            _getDisplayEvent(panel, buffer, sizeof(buffer), version);
+            client->send(buffer, "state", millis());
+        }
+    });
+    _webServer->addHandler(_displayEvents);
+    _displayEventsTask = new Task(CONFIG_WEBSITE_EVENTS_INTERVAL * TASK_MILLISECOND, TASK_FOREVER, [&] { _displayEventsCallback(); },
+        _scheduler, true, NULL, NULL, true);
+
+    // serve request for display state, which is rendered by the display only when it changed
+    // GET /display/state[?panel=<id>], the ETag is the version of the state
     _webServer->on("/display/state", HTTP_GET, [&](AsyncWebServerRequest* request) {
         // LOGD(TAG, "Serve /display/state");
-        AsyncResponseStream* response = request->beginResponseStream("application/json");
-        JsonDocument doc;
-        JsonObject root = doc.to<JsonObject>();
-        if (Display.isBusy()) {
-            root["state"] = "in_progress";
-        } else if (!Display.isInitialized()) {
-            root["state"] = "not_initialized";
-        } else {
-            root["state"] = "idle";
+        auto panel = _getPanelId(request);
+        if (panel < 0) {
+            request->send(404, "text/plain", "Unknown panel");
+            return;
         }
-        
-        root["img_idx"] = _imageIdx;
-        serializeJson(root, *response);
-        request->send(response);
-    }).setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED; }); 
-
-    // serve the logo (for main page)
-    _webServer->on("/thingy_logo", HTTP_GET, [](AsyncWebServerRequest* request) {
-        LOGD(TAG, "Serve thingy logo...");
-        AsyncWebServerResponse* response = request->beginResponse(200, "image/svg+xml", logo_thingy_start, logo_thingy_end - logo_thingy_start);
-        response->addHeader("Content-Encoding", "gzip");
-        response->addHeader("Cache-Control", "public, max-age=900");
-        request->send(response);
-    }).setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED; });
 
-    // serve the favicon.svg
-    _webServer->on("/favicon.svg", HTTP_GET, [](AsyncWebServerRequest* request) {
-        LOGD(TAG, "Serve favicon.svg...");
-        AsyncWebServerResponse* response = request->beginResponse(200, "image/svg+xml", favicon_svg_start, favicon_svg_end - favicon_svg_start);
-        response->addHeader("Content-Encoding", "gzip");
-        response->addHeader("Cache-Control", "public, max-age=900");
-        request->send(response);
-    }).setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED; });
+        char etag[12];
+        snprintf(etag, sizeof(etag), "\"%08" PRIx32 "\"", Displays[panel]->getStateVersion());
+        if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+            AsyncWebServerResponse* response = request->beginResponse(304);
+            response->addHeader("ETag", etag);
+            response->addHeader("Cache-Control", "no-cache");
+            request->send(response);
+            return;
+        }
 
-    // serve the apple-touch-icon
-    _webServer->on("/apple-touch-icon.png", HTTP_GET, [](AsyncWebServerRequest* request) {
-        LOGD(TAG, "Serve apple-touch-icon.png...");
-        AsyncWebServerResponse* response = request->beginResponse(200, "image/png", touchicon_start, touchicon_end - touchicon_start);
-        response->addHeader("Content-Encoding", "gzip");
-        response->addHeader("Cache-Control", "public, max-age=900");
+        char state[CONFIG_DISPLAY_STATE_LENGTH];
+        uint32_t version;
+        Displays[panel]->getState(state, sizeof(state), version);
+        snprintf(etag, sizeof(etag), "\"%08" PRIx32 "\"", version);
+        AsyncWebServerResponse* response = request->beginResponse(200, "application/json", state);
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
         request->send(response);
     }).setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED; });
 
-    // serve the favicon.png
-    _webServer->on("/favicon-96x96.png", HTTP_GET, [](AsyncWebServerRequest* request) {
-        LOGD(TAG, "Serve favicon-96x96.png...");
-        AsyncWebServerResponse* response = request->beginResponse(200, "image/png", favicon_96_png_start, favicon_96_png_end - favicon_96_png_start);
-        response->addHeader("Content-Encoding", "gzip");
-        response->addHeader("Cache-Control", "public, max-age=900");
+    // serve the content of the panel as bitmap (4 bit, indexed), generated while being sent
+    // GET /display/framebuffer[?panel=<id>], the ETag is the hash of the frame
+    _webServer->on("/display/framebuffer", HTTP_GET, [&](AsyncWebServerRequest* request) {
+        LOGD(TAG, "Serve /display/framebuffer");
+        auto panel = _getPanelId(request);
+        if (panel < 0) {
+            request->send(404, "text/plain", "Unknown panel");
+            return;
+        }
+        Soylent::PanelDisplayClass* display = Displays[panel];
+        uint32_t hash;
+        const uint8_t* frame = display->getFrame(hash);
+        if (frame == nullptr) {
+            request->send(503, "text/plain", "Content of the panel is unknown right now");
+            return;
+        }
+
+        char etag[12];
+        snprintf(etag, sizeof(etag), "\"%08" PRIx32 "\"", hash);
+        if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+            AsyncWebServerResponse* response = request->beginResponse(304);
+            response->addHeader("ETag", etag);
+            request->send(response);
+            return;
+        }
+
+        // the bitmap is sent chunked, so it can be ended early (a sized response would wait for the missing bytes)
+        Soylent::FrameBitmap bitmap(frame, Soylent::PanelDisplayClass::WIDTH, Soylent::PanelDisplayClass::HEIGHT, Soylent::PanelDisplayClass::ROTATION);
+        AsyncWebServerResponse* response = request->beginChunkedResponse("image/bmp", 
+            [bitmap, display, hash](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+                // the response is cut short, when the panel is changed in the meantime
+                uint32_t current_hash;
+                if (display->getFrame(current_hash) == nullptr || current_hash != hash)
+                    return 0;
+                return bitmap.read(buffer, maxLen, index);
+            });
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
         request->send(response);
     }).setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED; });
 
-    // serve the favicon.png
-    _webServer->on("/favicon-32x32.png", HTTP_GET, [](AsyncWebServerRequest* request) {
-        LOGD(TAG, "Serve favicon-32x32.png...");
-        AsyncWebServerResponse* response = request->beginResponse(200, "image/png", favicon_32_png_start, favicon_32_png_end - favicon_32_png_start);
-        response->addHeader("Content-Encoding", "gzip");
-        response->addHeader("Cache-Control", "public, max-age=900");
+    // serve request for timing of the recent display commands (in µs)
+    // GET /display/metrics[?panel=<id>]
+    _webServer->on("/display/metrics", HTTP_GET, [&](AsyncWebServerRequest* request) {
+        LOGD(TAG, "Serve /display/metrics");
+        auto panel = _getPanelId(request);
+        if (panel < 0) {
+            request->send(404, "text/plain", "Unknown panel");
+            return;
+        }
+        AsyncResponseStream* response = request->beginResponseStream("application/json");
+        response->addHeader("Cache-Control", "no-store");
+        JsonDocument doc;
+        JsonObject root = doc.to<JsonObject>();
+        Soylent::DisplayMetrics& metrics = Displays[panel]->getMetrics();
+
+        // min/avg/max per phase
+        Soylent::DisplayMetrics::phase_summary summary[Soylent::DisplayMetrics::PHASE_COUNT];
+        root["jobs_count"] = metrics.getSummary(summary);
+        JsonObject phases = root["phases"].to<JsonObject>();
+        for (uint8_t phase = 0; phase < Soylent::DisplayMetrics::PHASE_COUNT; phase++) {
+            JsonObject entry = phases[Soylent::DisplayMetrics::getPhaseName(static_cast<Soylent::DisplayMetrics::Phase>(phase))].to<JsonObject>();
+            entry["min_us"] = summary[phase].min_us;
+            entry["avg_us"] = summary[phase].avg_us;
+            entry["max_us"] = summary[phase].max_us;
+        }
+
+        // recent jobs, most recent first
+        JsonArray jobs = root["jobs"].to<JsonArray>();
+        Soylent::DisplayMetrics::job_metrics job;
+        for (size_t i = 0; metrics.getJob(i, job); i++) {
+            JsonObject entry = jobs.add<JsonObject>();
+            entry["command"] = job.command;
+            entry["total_us"] = job.total_us;
+            for (uint8_t phase = 0; phase < Soylent::DisplayMetrics::PHASE_COUNT; phase++) {
+                entry[Soylent::DisplayMetrics::getPhaseName(static_cast<Soylent::DisplayMetrics::Phase>(phase))] = job.phase_us[phase];
+            }
+            entry["spi_bytes"] = job.spi_bytes;
+            entry["spi_transfers"] = job.spi_transfers;
+        }
+
+        serializeJson(root, *response);
         request->send(response);
     }).setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED; });
 
-    // serve our home page here, yet only when the ESPConnect portal is not shown 
-    _webServer->on("/", HTTP_GET, [&](AsyncWebServerRequest* request) {
-        // LOGD(TAG, "Serve...");
-        AsyncWebServerResponse* response = request->beginResponse(200, "text/html", thingy_html_start, thingy_html_end - thingy_html_start);
-        response->addHeader("Content-Encoding", "gzip");
+    // serve the playlist
+    _webServer->on("/playlist", HTTP_GET, [&](AsyncWebServerRequest* request) {
+        LOGD(TAG, "Serve /playlist");
+        AsyncResponseStream* response = request->beginResponseStream("application/json");
+        response->addHeader("Cache-Control", "no-store");
+        JsonDocument doc;
+        JsonObject root = doc.to<JsonObject>();
+        root["running"] = Playlist.isRunning();
+        root["position"] = Playlist.getPosition();
+        JsonArray items = root["items"].to<JsonArray>();
+        Soylent::PlaylistClass::playlist_item item;
+        for (size_t i = 0; Playlist.getItem(i, item); i++) {
+            JsonObject entry = items.add<JsonObject>();
+            entry["src"] = item.image_name;
+            entry["dwell"] = item.dwell_s;
+            entry["img_idx"] = item.img_idx;
+        }
+        serializeJson(root, *response);
         request->send(response);
-    }).setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED; });
+    }).setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED && _fsMounted; });
+
+    // Prepare handler for changing the playlist
+    // {"items": [{"img_idx": 3, "dwell": 60}, ...], "running": true}, both are optional
+    _playlistHandler = new AsyncCallbackJsonWebHandler("/playlist");
+    _playlistHandler->setMethod(HTTP_PUT);
+    _playlistHandler->setFilter([&](__unused AsyncWebServerRequest* request) { return EventHandler.getState() != Mycila::ESPConnect::State::PORTAL_STARTED && _fsMounted; });
+    _playlistHandler->onRequest([&] (AsyncWebServerRequest* request, JsonVariant& json ) {
+        LOGD(TAG, "Serve PUT /playlist");
+        JsonObject root = json.as<JsonObject>();
+        if (root["items"].is<JsonArray>()) {
+            // only images from the images.json (not the hardcoded text) can be played
+            // ...the size is checked first, the items are put into a fixed array
+            JsonArray entries = root["items"].as<JsonArray>();
+            if (entries.size() > CONFIG_PLAYLIST_SIZE) {
+                request->send(400, "text/plain", "Too many items");
+                return;
+            }
+            size_t count = 0;
+            for (JsonVariant item : entries) {
+                int32_t img_idx = item["img_idx"] | 0;
+                const Soylent::ImageCatalog::catalog_entry* entry = img_idx > 2 ? _catalog.get(img_idx) : nullptr;
+                if (entry == nullptr || entry->src[0] == '\0') {
+                    request->send(400, "text/plain", "img_idx out of bounds");
+                    return;
+                }
+                Soylent::PlaylistClass::playlist_item& playlist_item = _playlistItems[count++];
+                strlcpy(playlist_item.image_name, entry->src, sizeof(playlist_item.image_name));
+                playlist_item.dwell_s = item["dwell"] | CONFIG_PLAYLIST_MIN_DWELL;
+                playlist_item.img_idx = img_idx;
+            }
+            if (!Playlist.setItems(_playlistItems, count)) {
+                request->send(400, "text/plain", "Invalid playlist");
+                return;
+            }
+        }
+        if (root["running"].is<bool>()) {
+            if (!root["running"].as<bool>()) {
+                Playlist.stop();
+            } else if (!Playlist.start()) {
+                request->send(400, "text/plain", "Playlist is empty");
+                return;
+            }
+        }
+        request->send(200, "text/plain", "OK");
+    });
+
+    // Register handler for changing the playlist
+    _webServer->addHandler(_playlistHandler);
 
     // // serve our home page here, yet only when the ESPConnect portal is not shown 
     // _webServer->on("/", HTTP_GET, [&](AsyncWebServerRequest* request) {
@@ -14,7 +14,55 @@ Soylent::ESPRestartClass ESPRestart;
 Soylent::ESPConnectClass ESPConnect(espConnect);
 Soylent::EventHandlerClass EventHandler(webServer, espConnect);
 SPIClass displaySpi(HSPI);
-Soylent::DisplayClass Display(displaySpi);
+Soylent::PanelDisplayClass Display(displaySpi, { DISPLAY_PIN_CS, DISPLAY_PIN_DC, DISPLAY_PIN_RST, DISPLAY_PIN_BUSY,
+    DISPLAY_PIN_SPI_SCK, DISPLAY_PIN_SPI_MISO, DISPLAY_PIN_SPI_MOSI, DISPLAY_PIN_SPI_SS });
+
+// Further panels are sharing the SPI bus of the first one,
+// unless their own SPI pins are given (the bus is DISPLAYn_SPI_HOST then, by default depending on the target:
+// VSPI on the ESP32, where FSPI is the bus of the flash, FSPI on the ESP32-S2/S3)
+#if CONFIG_DISPLAY_COUNT > 1
+    #ifdef CONFIG_IDF_TARGET_ESP32
+        #define DISPLAY_SPI_HOST_DEFAULT VSPI
+    #else
+        #define DISPLAY_SPI_HOST_DEFAULT FSPI
+    #endif
+    #ifdef DISPLAY1_PIN_SPI_SCK
+        #ifndef DISPLAY1_SPI_HOST
+            #define DISPLAY1_SPI_HOST DISPLAY_SPI_HOST_DEFAULT
+        #endif
+        SPIClass display1Spi(DISPLAY1_SPI_HOST);
+        Soylent::PanelDisplayClass Display1(display1Spi, { DISPLAY1_PIN_CS, DISPLAY1_PIN_DC, DISPLAY1_PIN_RST, DISPLAY1_PIN_BUSY,
+            DISPLAY1_PIN_SPI_SCK, DISPLAY1_PIN_SPI_MISO, DISPLAY1_PIN_SPI_MOSI, DISPLAY1_PIN_SPI_SS });
+    #else
+        Soylent::PanelDisplayClass Display1(displaySpi, { DISPLAY1_PIN_CS, DISPLAY1_PIN_DC, DISPLAY1_PIN_RST, DISPLAY1_PIN_BUSY,
+            DISPLAY_PIN_SPI_SCK, DISPLAY_PIN_SPI_MISO, DISPLAY_PIN_SPI_MOSI, DISPLAY_PIN_SPI_SS });
+    #endif
+#endif
+#if CONFIG_DISPLAY_COUNT > 2
+    #ifdef DISPLAY2_PIN_SPI_SCK
+        #ifndef DISPLAY2_SPI_HOST
+            #define DISPLAY2_SPI_HOST DISPLAY_SPI_HOST_DEFAULT
+        #endif
+        SPIClass display2Spi(DISPLAY2_SPI_HOST);
+        Soylent::PanelDisplayClass Display2(display2Spi, { DISPLAY2_PIN_CS, DISPLAY2_PIN_DC, DISPLAY2_PIN_RST, DISPLAY2_PIN_BUSY,
+            DISPLAY2_PIN_SPI_SCK, DISPLAY2_PIN_SPI_MISO, DISPLAY2_PIN_SPI_MOSI, DISPLAY2_PIN_SPI_SS });
+    #else
+        Soylent::PanelDisplayClass Display2(displaySpi, { DISPLAY2_PIN_CS, DISPLAY2_PIN_DC, DISPLAY2_PIN_RST, DISPLAY2_PIN_BUSY,
+            DISPLAY_PIN_SPI_SCK, DISPLAY_PIN_SPI_MISO, DISPLAY_PIN_SPI_MOSI, DISPLAY_PIN_SPI_SS });
+    #endif
+#endif
+
+// Panels by their ID (as used by the web API), the first one is Display
+Soylent::PanelDisplayClass* Displays[CONFIG_DISPLAY_COUNT] = {
+    &Display,
+    #if CONFIG_DISPLAY_COUNT > 1
+        &Display1,
+    #endif
+    #if CONFIG_DISPLAY_COUNT > 2
+        &Display2,
+    #endif
+};
+Soylent::PlaylistClass Playlist;
 Soylent::WebServerClass WebServer(webServer);
 Soylent::WebSiteClass WebSite(webServer);
 
@@ -57,8 +105,13 @@ void setup() {
     // Will also spawn the WebServer and WebSite (when ESPConnect says so...)
     EventHandler.begin(&scheduler);
 
-    // Add Display-Task to Scheduler
-    Display.begin(&scheduler);
+    // Add Display-Tasks to Scheduler (each panel has a worker of its own)
+    for (auto display : Displays) {
+        display->begin(&scheduler);
+    }
+
+    // Add Playlist-Task to Scheduler (resumes a running playlist)
+    Playlist.begin(&scheduler);
 }
 
 void loop() {
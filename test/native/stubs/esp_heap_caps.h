@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#pragma once
+
+// Host stand-in for the heap of ESP-IDF, counting the calls for tests asserting on the heap
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+struct heap_caps_calls
+{
+    size_t allocations;
+    size_t frees;
+};
+
+inline heap_caps_calls heap_caps_counter = {0, 0};
+
+inline void* heap_caps_malloc(size_t size, uint32_t caps) {
+    // there is no PSRAM on the host
+    if (caps & MALLOC_CAP_SPIRAM)
+        return nullptr;
+    heap_caps_counter.allocations++;
+    return malloc(size);
+}
+
+inline void heap_caps_free(void* ptr) {
+    if (ptr != nullptr)
+        heap_caps_counter.frees++;
+    free(ptr);
+}
@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <cstdio>
+#include <new>
+#include <unity.h>
+#include <esp_heap_caps.h>
+#include <FrameCache.h>
+
+using namespace Soylent;
+
+// frame of the 200x200 panel (black plane followed by red plane)
+static constexpr size_t FRAME_BYTES = 2 * 200 / 8 * 200;
+static constexpr size_t IMAGES = 5;
+static constexpr size_t COMMANDS = 1000;
+
+// allocations by new (e.g. of std::string or std::list) are counted as well
+static size_t new_calls = 0;
+
+void* operator new(size_t size) {
+    new_calls++;
+    void* ptr = malloc(size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+static const char* image_name(size_t image) {
+    static const char* names[IMAGES] = { "/a.epd", "/b.epd", "/c.epd", "/d.epd", "/e.epd" };
+    return names[image % IMAGES];
+}
+
+// Cache accesses of the display worker showing an image: frames are filled on a miss
+static void show_image(FrameCache& cache, const char* imageName) {
+    if (cache.get(imageName) != nullptr)
+        return;
+    uint8_t* frame = cache.insert(imageName, FRAME_BYTES);
+    if (frame != nullptr) {
+        memset(frame, imageName[1], FRAME_BYTES);
+        cache.commit(imageName);
+    }
+}
+
+void setUp() {
+    srand(42);
+}
+
+void tearDown() {
+}
+
+// Once the budget is filled, showing images doesn't touch the heap anymore
+// ...more images than fit into the budget, and the cache is dropped now and then (as for an upload)
+void test_commands_dont_allocate_once_filled() {
+    FrameCache cache;
+    cache.setBudget(3 * FRAME_BYTES);
+    for (size_t image = 0; image < IMAGES; image++)
+        show_image(cache, image_name(image));
+
+    heap_caps_calls before = heap_caps_counter;
+    size_t new_calls_before = new_calls;
+    for (size_t command = 0; command < COMMANDS; command++) {
+        if (command % 97 == 0)
+            cache.clear();
+        else if (command % 13 == 0)
+            cache.remove(image_name(rand()));
+        show_image(cache, image_name(rand()));
+    }
+    char message[96];
+    snprintf(message, sizeof(message), "%u commands: %u allocations, %u frees, %u new",
+             static_cast<unsigned>(COMMANDS),
+             static_cast<unsigned>(heap_caps_counter.allocations - before.allocations),
+             static_cast<unsigned>(heap_caps_counter.frees - before.frees),
+             static_cast<unsigned>(new_calls - new_calls_before));
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_size_t(before.allocations, heap_caps_counter.allocations);
+    TEST_ASSERT_EQUAL_size_t(before.frees, heap_caps_counter.frees);
+    TEST_ASSERT_EQUAL_size_t(new_calls_before, new_calls);
+    TEST_ASSERT_TRUE(cache.getUsage() <= cache.getBudget());
+}
+
+// Frames are only released when the budget shrinks, and all of them with the cache
+void test_frames_released_with_budget() {
+    heap_caps_calls before = heap_caps_counter;
+    {
+        FrameCache cache;
+        cache.setBudget(3 * FRAME_BYTES);
+        for (size_t image = 0; image < IMAGES; image++)
+            show_image(cache, image_name(image));
+        TEST_ASSERT_EQUAL_size_t(3 * FRAME_BYTES, cache.getUsage());
+
+        cache.setBudget(FRAME_BYTES);
+        TEST_ASSERT_EQUAL_size_t(FRAME_BYTES, cache.getUsage());
+        TEST_ASSERT_EQUAL_size_t(2, heap_caps_counter.frees - before.frees);
+        TEST_ASSERT_NOT_NULL(cache.get(image_name(IMAGES - 1)));
+    }
+    TEST_ASSERT_EQUAL_size_t(heap_caps_counter.allocations - before.allocations, heap_caps_counter.frees - before.frees);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_commands_dont_allocate_once_filled);
+    RUN_TEST(test_frames_released_with_budget);
+    return UNITY_END();
+}
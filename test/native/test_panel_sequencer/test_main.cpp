@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <cstdlib>
+#include <vector>
+#include <unity.h>
+#include <PanelSequencer.h>
+
+using namespace Soylent;
+
+// geometry of the 200x200 panel
+static constexpr uint16_t WIDTH = 200;
+static constexpr uint16_t HEIGHT = 200;
+static constexpr size_t ROW_BYTES = WIDTH / 8;
+
+// bytes on the bus, with the level of DC (commands are sent with DC low)
+struct bus_byte
+{
+    bool data;
+    uint8_t value;
+    bool operator==(const bus_byte& other) const {
+        return data == other.data && value == other.value;
+    }
+};
+
+// Link recording the bytes put together by PanelSequencer, instead of sending them
+class RecordingBus : public PanelSequencer<RecordingBus> {
+public:
+    std::vector<bus_byte> bytes;
+    size_t transfers = 0;
+
+private:
+    friend class PanelSequencer<RecordingBus>;
+    void _writeCommand(uint8_t command, const uint8_t* data, size_t length) {
+        bytes.push_back({false, command});
+        for (size_t i = 0; i < length; i++)
+            bytes.push_back({true, data[i]});
+    }
+    void _startTransfer() {
+    }
+    void _transfer(const uint8_t* data, size_t length) {
+        transfers++;
+        for (size_t i = 0; i < length; i++)
+            bytes.push_back({true, data[i]});
+    }
+    void _endTransfer() {
+    }
+};
+
+// The same sequences as sent by GxEPD2 (1.6.1, as in platformio.ini) for the GxEPD2_154_Z90c
+// transcribed from GxEPD2_154_Z90c::_setPartialRamArea() and the color part of writeImagePart()
+class Gxepd2Reference {
+public:
+    std::vector<bus_byte> bytes;
+
+    void _setPartialRamArea(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+        _writeCommand(0x11); // set ram entry mode
+        _writeData(0x03);    // x increase, y increase : normal mode
+        _writeCommand(0x44);
+        _writeData(x / 8);
+        _writeData((x + w - 1) / 8);
+        _writeCommand(0x45);
+        _writeData(y % 256);
+        _writeData(y / 256);
+        _writeData((y + h - 1) % 256);
+        _writeData((y + h - 1) / 256);
+        _writeCommand(0x4e);
+        _writeData(x / 8);
+        _writeCommand(0x4f);
+        _writeData(y % 256);
+        _writeData(y / 256);
+    }
+
+    // rows of the color (red) plane, as written by writeImagePart() with invert and mirror_y false
+    void writeColorPart(const uint8_t* color, int16_t x_part, int16_t y_part, int16_t w_bitmap, int16_t w1, int16_t h1) {
+        int16_t wb_bitmap = (w_bitmap + 7) / 8;
+        _writeCommand(0x26);
+        for (int16_t i = 0; i < h1; i++) {
+            for (int16_t j = 0; j < w1 / 8; j++) {
+                int16_t idx = x_part / 8 + j + (y_part + i) * wb_bitmap;
+                uint8_t data = color[idx];
+                _writeData(~data);
+            }
+        }
+    }
+
+private:
+    void _writeCommand(uint8_t c) {
+        bytes.push_back({false, c});
+    }
+    void _writeData(uint8_t d) {
+        bytes.push_back({true, d});
+    }
+};
+
+static void assert_same_bytes(const std::vector<bus_byte>& expected, const std::vector<bus_byte>& actual) {
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(expected.size(), actual.size(), "number of bytes");
+    for (size_t i = 0; i < expected.size(); i++) {
+        TEST_ASSERT_EQUAL_MESSAGE(expected[i].data, actual[i].data, "level of DC");
+        TEST_ASSERT_EQUAL_HEX8(expected[i].value, actual[i].value);
+    }
+}
+
+void setUp() {
+    srand(42);
+}
+
+void tearDown() {
+}
+
+// windows as sent for bands of the display worker: full rows, partial rows, the last band and single bytes
+void test_set_ram_window_matches_gxepd2() {
+    const uint16_t windows[][4] = {
+        { 0, 0, ROW_BYTES, 8 },
+        { 3, 8, 10, 8 },
+        { 0, 192, ROW_BYTES, 8 },
+        { 24, 199, 1, 1 },
+        { 12, 100, 1, 50 },
+    };
+    for (const auto& window : windows) {
+        RecordingBus bus;
+        bus.setRamWindow(window[0], window[1], window[2], window[3]);
+        Gxepd2Reference reference;
+        reference._setPartialRamArea(window[0] * 8, window[1], window[2] * 8, window[3]);
+        assert_same_bytes(reference.bytes, bus.bytes);
+    }
+}
+
+// the red plane of a frame (0 is ink) is inverted for the controller (1 is red), as by GxEPD2
+void test_write_red_plane_matches_gxepd2() {
+    static uint8_t red[ROW_BYTES * HEIGHT];
+    for (auto& value : red)
+        value = static_cast<uint8_t>(rand());
+
+    const uint16_t windows[][4] = {
+        { 0, 0, ROW_BYTES, 8 },
+        { 3, 8, 10, 8 },
+        { 0, 0, ROW_BYTES, HEIGHT },
+    };
+    for (const auto& window : windows) {
+        uint16_t x_byte = window[0];
+        uint16_t y = window[1];
+        RecordingBus bus;
+        bus.writeRam(RecordingBus::RAM_RED, red + y * ROW_BYTES + x_byte, window[2], window[3], ROW_BYTES);
+        Gxepd2Reference reference;
+        reference.writeColorPart(red, x_byte * 8, y, WIDTH, window[2] * 8, window[3]);
+        assert_same_bytes(reference.bytes, bus.bytes);
+    }
+}
+
+// the black plane is sent as it is, contiguous rows in a single transfer
+void test_write_black_plane_as_is() {
+    static uint8_t black[ROW_BYTES * 8];
+    for (auto& value : black)
+        value = static_cast<uint8_t>(rand());
+
+    RecordingBus bus;
+    bus.writeRam(RecordingBus::RAM_BLACK, black, ROW_BYTES, 8, ROW_BYTES);
+    TEST_ASSERT_EQUAL_size_t(1 + sizeof(black), bus.bytes.size());
+    TEST_ASSERT_EQUAL_size_t(1, bus.transfers);
+    TEST_ASSERT_FALSE(bus.bytes[0].data);
+    TEST_ASSERT_EQUAL_HEX8(0x24, bus.bytes[0].value);
+    for (size_t i = 0; i < sizeof(black); i++)
+        TEST_ASSERT_EQUAL_HEX8(black[i], bus.bytes[1 + i].value);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_set_ram_window_matches_gxepd2);
+    RUN_TEST(test_write_red_plane_matches_gxepd2);
+    RUN_TEST(test_write_black_plane_as_is);
+    return UNITY_END();
+}
@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright (C) 2024 Robert Wendlandt
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unity.h>
+#include <PixelTransform.h>
+
+using namespace Soylent;
+
+// geometry of a bitmap plane of the 200x200 panel (bitmap rows are aligned by 4 bytes)
+static constexpr size_t ROW_BYTES = 25;
+static constexpr size_t BMP_ROW_BYTES = 28;
+static constexpr size_t ROWS = 200;
+
+// Nibble-table bit reversal, as used by the bitmap fallback before PixelTransform
+static unsigned char lookup[16] = {
+0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
+0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf, };
+
+static uint8_t reverse(uint8_t n) {
+   // Reverse the top and bottom nibble then swap them.
+   return (lookup[n&0b1111] << 4) | lookup[n>>4];
+}
+
+static void reverse_pxcpy(uint8_t *__restrict dst, const uint8_t *__restrict src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[n-1-i] = reverse(src[i]);
+}
+
+// the same transform as PixelTransform::transformRows(), byte by byte on top of the nibble table
+static void reference_transform(uint8_t* dst, const uint8_t* src, size_t rows, size_t rowBytes, size_t srcStride, uint8_t flags) {
+    for (size_t row = 0; row < rows; row++) {
+        const uint8_t* s = src + ((flags & PixelTransform::FLIP_Y) ? rows - 1 - row : row) * srcStride;
+        uint8_t* d = dst + row * rowBytes;
+        if (flags & PixelTransform::MIRROR_X)
+            reverse_pxcpy(d, s, rowBytes);
+        else
+            memcpy(d, s, rowBytes);
+        if (flags & PixelTransform::INVERT) {
+            for (size_t x = 0; x < rowBytes; x++)
+                d[x] = ~d[x];
+        }
+    }
+}
+
+static void fill_random(uint8_t* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        buffer[i] = static_cast<uint8_t>(rand());
+}
+
+void setUp() {
+    srand(42);
+}
+
+void tearDown() {
+}
+
+void test_reverse_bits_matches_nibble_table() {
+    for (unsigned v = 0; v < 256; v++)
+        TEST_ASSERT_EQUAL_HEX8(reverse(v), PixelTransform::reverseBits(static_cast<uint8_t>(v)));
+}
+
+// all lengths around the 4 byte words, including the tails
+void test_mirror_row_matches_nibble_table() {
+    uint8_t src[64];
+    uint8_t expected[64];
+    uint8_t actual[64];
+    for (size_t n = 0; n <= sizeof(src); n++) {
+        fill_random(src, n);
+        reverse_pxcpy(expected, src, n);
+        PixelTransform::mirrorRow(actual, src, n);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, actual, n);
+
+        for (size_t i = 0; i < n; i++)
+            expected[i] = ~expected[i];
+        PixelTransform::mirrorRow(actual, src, n, 0xFFFFFFFFu);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, actual, n);
+    }
+}
+
+void test_transform_rows_matches_nibble_table() {
+    static uint8_t src[ROWS * BMP_ROW_BYTES];
+    static uint8_t expected[ROWS * ROW_BYTES];
+    static uint8_t actual[ROWS * ROW_BYTES];
+    fill_random(src, sizeof(src));
+    for (uint8_t flags = 0; flags <= (PixelTransform::MIRROR_X | PixelTransform::FLIP_Y | PixelTransform::INVERT); flags++) {
+        reference_transform(expected, src, ROWS, ROW_BYTES, BMP_ROW_BYTES, flags);
+        PixelTransform::transformRows(actual, src, ROWS, ROW_BYTES, BMP_ROW_BYTES, flags);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, actual, sizeof(expected));
+
+        memset(actual, 0, sizeof(actual));
+        PixelTransform::transformRows<ROW_BYTES, BMP_ROW_BYTES>(actual, src, ROWS, flags);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, actual, sizeof(expected));
+    }
+}
+
+// Timing of a bitmap plane being mirrored (as done for each band by the display worker)
+// ...only reported, the host says little about the ESP32
+void test_benchmark_mirror_plane() {
+    static constexpr int ROUNDS = 2000;
+    static uint8_t src[ROWS * BMP_ROW_BYTES];
+    static uint8_t dst[ROWS * ROW_BYTES];
+    fill_random(src, sizeof(src));
+    volatile uint8_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (size_t row = 0; row < ROWS; row++)
+            reverse_pxcpy(dst + row * ROW_BYTES, src + row * BMP_ROW_BYTES, ROW_BYTES);
+        sink = sink + dst[round % sizeof(dst)];
+    }
+    double table_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        PixelTransform::transformRows<ROW_BYTES, BMP_ROW_BYTES>(dst, src, ROWS, PixelTransform::MIRROR_X);
+        sink = sink + dst[round % sizeof(dst)];
+    }
+    double kernel_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+    char message[128];
+    snprintf(message, sizeof(message), "mirror %ux%u plane: nibble table %.2f us, PixelTransform %.2f us (%.1fx)",
+             static_cast<unsigned>(ROW_BYTES * 8), static_cast<unsigned>(ROWS), table_us, kernel_us, table_us / kernel_us);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_reverse_bits_matches_nibble_table);
+    RUN_TEST(test_mirror_row_matches_nibble_table);
+    RUN_TEST(test_transform_rows_matches_nibble_table);
+    RUN_TEST(test_benchmark_mirror_plane);
+    return UNITY_END();
+}
@@ -1,6 +1,7 @@
 import gzip
 import os
 import sys
+import zlib
 
 os.makedirs('.pio/assets', exist_ok=True)
 
@@ -16,8 +17,46 @@ for filename in ['logo_captive.svg', 'apple-touch-icon.png', 'favicon-96x96.png'
         sys.stderr.write(f"assets.py: {filename} up to date\n")
         continue
     with open('assets/' + filename, 'rb') as inputFile:
-        with gzip.open('.pio/assets/' + filename + '.gz', 'wb') as outputFile:            
+        with gzip.open('.pio/assets/' + filename + '.gz', 'wb') as outputFile:
             sys.stderr.write(f"assets.py: gzip \'assets/{filename}\' to \'.pio/assets/{filename}.gz\'\n")
             outputFile.writelines(inputFile)
     with open('.pio/assets/' + filename + '.timestamp', 'w', -1, 'utf-8') as timestampFile:
-        timestampFile.write(str(os.path.getmtime('assets/' + filename)))
\ No newline at end of file
+        timestampFile.write(str(os.path.getmtime('assets/' + filename)))
+
+# list the embedded files served by the web server here (file, path, mime type, served while the captive portal is shown)!
+# thingy.html.gz is created by customize_thingy_html.py, which needs to run before this script
+assets = [
+    ('logo_captive.svg.gz', '/logo', 'image/svg+xml', True),
+    ('logo_thingy.svg.gz', '/thingy_logo', 'image/svg+xml', False),
+    ('favicon.svg.gz', '/favicon.svg', 'image/svg+xml', False),
+    ('apple-touch-icon.png.gz', '/apple-touch-icon.png', 'image/png', False),
+    ('favicon-96x96.png.gz', '/favicon-96x96.png', 'image/png', False),
+    ('favicon-32x32.png.gz', '/favicon-32x32.png', 'image/png', False),
+    ('thingy.html.gz', '/', 'text/html', False),
+]
+
+# write the table of embedded assets (see EmbeddedAssets.h), with their size and crc32 (for ETags) at build time
+lines = "// DO NOT EDIT - Created by assets.py\n"
+lines += "#pragma once\n\n#include <EmbeddedAssets.h>\n\n"
+entries = ""
+for filename, path, mimeType, portal in assets:
+    symbol = '_binary__pio_assets_' + filename.replace('.', '_').replace('-', '_')
+    with open('.pio/assets/' + filename, 'rb') as inputFile:
+        content = inputFile.read()
+    lines += f"extern const uint8_t {symbol}_start[] asm(\"{symbol}_start\");\n"
+    entries += f"        {{\"{path}\", \"{mimeType}\", \"gzip\", {symbol}_start, {len(content)}, \"\\\"{zlib.crc32(content):08x}\\\"\", {'true' if portal else 'false'}}},\n"
+lines += "\nnamespace Soylent {\n"
+lines += "    constexpr embedded_asset EMBEDDED_ASSETS[] = {\n" + entries + "    };\n"
+lines += "} // namespace Soylent\n"
+
+# ...only when changed, so nothing is rebuilt needlessly
+tableName = '.pio/assets/asset_table.h'
+if os.path.isfile(tableName):
+    with open(tableName, 'r', -1, 'utf-8') as tableFile:
+        if tableFile.read() == lines:
+            sys.stderr.write(f"assets.py: {tableName} up to date\n")
+            lines = None
+if lines is not None:
+    sys.stderr.write(f"assets.py: write \'{tableName}\'\n")
+    with open(tableName, 'w', -1, 'utf-8') as tableFile:
+        tableFile.write(lines)
@@ -10,8 +10,31 @@ be replaced by a few lines of python code.
 The Black-White-Red.act defines 3 colors black (0,0,0), red(255,0,0) and white (255,255,255).
 No need to read it here, a palette for conversion is defined on the fly.
 
-This script creates two 1-bit bitmap images from an svg input file: one for the black pixels
-and one for the red pixels.
+This script creates a panel-native image (.epd) from an svg input file. It contains a small
+header (geometry, rotation, checksum) followed by the 1-bit plane for the black pixels and
+the 1-bit plane for the red pixels. Both planes are already rotated to match the display's
+setRotation(2), so the firmware can pass them to writeImage without any transformation.
+As e-paper art is mostly white, the planes are compressed with RLE (PackBits) or LZSS,
+whichever is the smallest for the image (or stored raw, if neither is saving space).
+The firmware decodes them incrementally while feeding the panel.
+
+Layout of the .epd container (little-endian):
+    char[4]  magic "EPDI"
+    uint8    version
+    uint8    rotation the planes were prepared for
+    uint8    flags (encoding of the planes: 0 = raw, 1 = RLE, 2 = LZSS)
+    uint8    reserved
+    uint16   width
+    uint16   height
+    uint32   size of each plane, in bytes
+    uint32   crc32 over both planes
+    uint32   size of the compressed black plane (only, when compressed)
+    uint8[]  black plane, then red plane (rows top to bottom, MSB first, 0 = ink)
+
+RLE (PackBits): a control byte n < 128 is followed by n + 1 literal bytes,
+    n > 128 is followed by one byte to repeat 257 - n times
+LZSS: a flag byte (LSB first) for the next eight items, 1 = a literal byte,
+    0 = a match of two bytes (distance - 1, length - 3) within the last 256 bytes
 
 The code for importing svg-images is adapted from [sphinxext-photofinish](https://github.com/wpilibsuite/sphinxext-photofinish)
 """
@@ -23,7 +46,9 @@ The code for importing svg-images is adapted from [sphinxext-photofinish](https:
 
 import os
 import sys
+import struct
 import subprocess
+import zlib
 from dataclasses import dataclass
 from pathlib import Path
 from shutil import which, copy
@@ -37,6 +62,19 @@ except ModuleNotFoundError:
     env.Execute('"$PYTHONEXE" -m pip install pillow')
     from PIL import Image
 
+# keep in sync with EPDIMAGEHEADER in DisplayTask.h
+EPD_IMAGE_MAGIC = b'EPDI'
+EPD_IMAGE_VERSION = 1
+EPD_IMAGE_ROTATION = 2
+EPD_IMAGE_FLAG_RAW = 0x00
+EPD_IMAGE_FLAG_RLE = 0x01
+EPD_IMAGE_FLAG_LZSS = 0x02
+
+# keep in sync with PlaneDecoder.h
+LZSS_WINDOW = 256
+LZSS_MIN_MATCH = 3
+LZSS_MAX_MATCH = 255 + LZSS_MIN_MATCH
+
 class NoToolError(RuntimeError):
     """No tool for conversion found."""
     pass
@@ -233,26 +271,139 @@ def svg_to_png(
 
     raise FailedConversionError("\n".join(err_msg + log))
 
+def mono_to_plane(image):
+    """
+    Packs a 1bit image into a plane in the byte order of the panel's RAM
+    (rotated by 180 degrees to match the display's setRotation(2))
+    """
+
+    return image.transpose(Image.Transpose.ROTATE_180).tobytes()
+
+def rle_encode(plane: bytes) -> bytes:
+    """
+    Compresses a plane with PackBits, runs of 3 and more bytes are repeated
+    """
+
+    out = bytearray()
+    literals = bytearray()
+    i = 0
+    while i < len(plane):
+        run = 1
+        while i + run < len(plane) and run < 128 and plane[i + run] == plane[i]:
+            run += 1
+        if run >= 3:
+            if literals:
+                out += bytes([len(literals) - 1]) + literals
+                literals = bytearray()
+            out += bytes([257 - run, plane[i]])
+            i += run
+            continue
+        literals.append(plane[i])
+        i += 1
+        if len(literals) == 128:
+            out += bytes([len(literals) - 1]) + literals
+            literals = bytearray()
+    if literals:
+        out += bytes([len(literals) - 1]) + literals
+    return bytes(out)
+
+def lzss_encode(plane: bytes) -> bytes:
+    """
+    Compresses a plane with LZSS (greedy, longest match within the window)
+    """
+
+    out = bytearray()
+    items = []
+    i = 0
+    while i < len(plane):
+        best_length = 0
+        best_distance = 0
+        for distance in range(1, min(i, LZSS_WINDOW) + 1):
+            length = 0
+            while (i + length < len(plane) and length < LZSS_MAX_MATCH and
+                   plane[i + length] == plane[i - distance + length]):
+                length += 1
+            if length > best_length:
+                best_length = length
+                best_distance = distance
+                if length == LZSS_MAX_MATCH:
+                    break
+        if best_length >= LZSS_MIN_MATCH:
+            items.append(bytes([best_distance - 1, best_length - LZSS_MIN_MATCH]))
+            i += best_length
+        else:
+            items.append(bytes([plane[i]]))
+            i += 1
+    for group in range(0, len(items), 8):
+        flags = 0
+        for bit, item in enumerate(items[group:group + 8]):
+            if len(item) == 1:
+                flags |= 1 << bit
+        out.append(flags)
+        for item in items[group:group + 8]:
+            out += item
+    return bytes(out)
+
+def encode_planes(plane_black: bytes, plane_red: bytes):
+    """
+    Picks the smallest encoding of both planes, returns the flags and the payload
+    """
+
+    candidates = [(EPD_IMAGE_FLAG_RAW, plane_black + plane_red)]
+    for flag, encode in [(EPD_IMAGE_FLAG_RLE, rle_encode), (EPD_IMAGE_FLAG_LZSS, lzss_encode)]:
+        black = encode(plane_black)
+        red = encode(plane_red)
+        candidates.append((flag, struct.pack('<I', len(black)) + black + red))
+    return min(candidates, key=lambda candidate: len(candidate[1]))
+
+def write_epd(
+    epd_path: Union[str, Path],
+    image_bw,
+    image_rw,
+):
+    """
+    Writes the black and red planes into a panel-native .epd container
+    """
+
+    plane_black = mono_to_plane(image_bw)
+    plane_red = mono_to_plane(image_rw)
+    planes = plane_black + plane_red
+    flags, payload = encode_planes(plane_black, plane_red)
+    header = struct.pack('<4sBBBBHHII',
+                         EPD_IMAGE_MAGIC,
+                         EPD_IMAGE_VERSION,
+                         EPD_IMAGE_ROTATION,
+                         flags,
+                         0,
+                         image_bw.width,
+                         image_bw.height,
+                         len(plane_black),
+                         zlib.crc32(planes))
+    with open(epd_path, 'wb') as epdFile:
+        epdFile.write(header)
+        epdFile.write(payload)
+    sys.stderr.write(f"svg2rbmono.py: {os.path.basename(epd_path)} {len(planes)} -> {len(payload)} bytes (flags {flags})\n")
+
 def svg_to_mono(
     svg_path: Union[str, Path],
     width: Optional[int] = None,
     height: Optional[int] = None,
 ):
     """
-    Converts a svg to red/white and black/white 1bit bitmap images
+    Converts a svg to red/white and black/white 1bit planes in a panel-native image
     """
 
     svg_path = str(svg_path)
     png_out_path = f'{os.path.splitext(svg_path)[0]}.png'
-    rw_out_path = f'{os.path.splitext(svg_path)[0]}.r.bmp'
-    bw_out_path = f'{os.path.splitext(svg_path)[0]}.b.bmp'
+    epd_out_path = f'{os.path.splitext(svg_path)[0]}.epd'
 
+    # the panel's size, icons (for compositions) may be smaller with a width of a multiple of 8
     if width is None and height is None:
         width = 200
         height = 200
 
     # convert svg to png
-    svg_to_png(svg_path, png_out_path, 200, 200)
+    svg_to_png(svg_path, png_out_path, width, height)
 
     # open the png from file
     with Image.open(png_out_path) as input_image:
@@ -282,8 +433,6 @@ def svg_to_mono(
                                         palette = Image.Palette.ADAPTIVE,
                                         dither=Image.Dither.NONE, colors=2)
             image_rw = image_rw.convert('1')
-            # write the image to file
-            image_rw.save(rw_out_path, 'BMP')
 
             # convert black/red/white image to black/white
             # first modify palette from [white, red, black] to [white, white, black]
@@ -296,8 +445,9 @@ def svg_to_mono(
                                         palette = Image.Palette.ADAPTIVE,
                                         dither=Image.Dither.NONE, colors=2)
             image_bw = image_bw.convert('1')
-            # write the image to file
-            image_bw.save(bw_out_path, 'BMP')
+
+            # write both planes to file
+            write_epd(epd_out_path, image_bw, image_rw)
 
     # delete temporary png
     os.remove(png_out_path)
@@ -309,7 +459,8 @@ os.makedirs('.pio/assets/fs_images', exist_ok=True)
 # list the svgs for conversion here!
 for filename in ['img_door_open.svg', 'img_locked.svg', 'img_logo.svg', 'img_test.svg', 'img_unlocked.svg']:
     skip = False
-    if os.path.isfile('.pio/assets/fs_images/' + filename + '.timestamp'):
+    epd_filename = os.path.splitext(filename)[0] + '.epd'
+    if os.path.isfile('.pio/assets/fs_images/' + filename + '.timestamp') and os.path.isfile('data/' + epd_filename):
         with open('.pio/assets/fs_images/' + filename + '.timestamp', 'r', -1, 'utf-8') as timestampFile:
             if os.path.getmtime('assets/fs_images/' + filename) == float(timestampFile.readline()):
                 skip = True